@@ -0,0 +1,319 @@
+//
+//  arith.c
+//  CPrimeFinder
+//
+//  Multiplicative functions over [lo, hi] (--arith=phi|mu|sigma|mertens,
+//  --from=lo). Each segment keeps, per number, the function value so far and
+//  the product of the prime powers found so far. Every base prime p <= sqrt(hi)
+//  walks its multiples once per power p^k:
+//
+//      phi:   * (p - 1) on multiples of p, * p on multiples of p^k, k >= 2
+//      mu:    negated on multiples of p, 0 on multiples of p^2
+//      sigma: * (1 + p) on multiples of p, then (1 + .. + p^(k-1)) becomes
+//             (1 + .. + p^k) on multiples of p^k
+//
+//  Whatever is left of n after the product is a single prime above sqrt(n).
+//  Nothing outside the segment buffers and the base primes is resident, so
+//  memory is O(sqrt(hi)) per thread. Mertens sums mu from 1 even when lo is
+//  larger: each segment records its own sum and extremes, and they are chained
+//  onto a running prefix as the segments finish in order.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+//numbers per segment unless --segment is given; each one takes 16 bytes of state
+#define ARITH_SEGMENT_SIZE (32LL * 1024)
+
+static const char *const arith_names[] = { "none", "phi", "mu", "sigma", "mertens" };
+
+const char *arith_name(ArithFn fn) {
+    return arith_names[fn];
+}
+
+//Looks up an --arith value; returns 0 for an unknown name
+int parse_arith(const char *name, ArithFn *out) {
+    for (int i = ARITH_PHI; i < (int)(sizeof(arith_names) / sizeof(arith_names[0])); ++i) {
+        if (strcmp(name, arith_names[i]) == 0) {
+            *out = (ArithFn)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Running Mertens sum inside one segment, from 0 at its start
+typedef struct {
+    long long sum;
+    long long max, max_at;    // extremes over the part of the segment >= lo
+    long long min, min_at;
+    int seen;
+} MertensSegment;
+
+//Result of one segment, delivered in segment order: the listed text, or for
+//Mertens its sums and (when listing) mu, since its values depend on the
+//segments before it
+typedef struct {
+    TextBuf text;
+    MertensSegment mertens;
+    signed char *mu;
+    long long lo;
+    long long len_mu;
+} ArithText;
+
+typedef struct {
+    long long *value;         // function value so far
+    unsigned long long *found;// product of the prime powers found so far
+    u128 sum;                 // phi and sigma
+    long long mu_count[3];    // mu = -1, 0, 1
+    char pad[64];
+} ArithWorker;
+
+typedef struct {
+    ArithFn fn;
+    long long lo;             // first number reported
+    long long hi;
+    const long long *primes;  // 2 followed by the odd base primes
+    long long nprimes;
+    ArithWorker *workers;
+    int list;
+    OrderedOutput output;     // ArithText per segment, taken in segment order
+    MertensSegment mertens;   // M(n) at the last segment taken and the extremes so far
+} ArithContext;
+
+//Applies every base prime to [seg_lo, seg_hi) and finishes each value
+static void arith_sieve(const ArithContext *ctx, ArithWorker *w, long long seg_lo, long long seg_hi) {
+    long long len = seg_hi - seg_lo;
+    long long *value = w->value;
+    unsigned long long *found = w->found;
+    for (long long i = 0; i < len; ++i) {
+        value[i] = 1;
+        found[i] = 1;
+    }
+    long long last = seg_hi - 1;
+    for (long long k = 0; k < ctx->nprimes; ++k) {
+        long long p = ctx->primes[k];
+        if (p > last / p) break;
+        long long first = ((seg_lo + p - 1) / p) * p;
+        for (long long m = first; m < seg_hi; m += p) {
+            long long i = m - seg_lo;
+            found[i] *= (unsigned long long)p;
+            if (ctx->fn == ARITH_PHI) value[i] *= p - 1;
+            else if (ctx->fn == ARITH_SIGMA) value[i] *= p + 1;
+            else value[i] = -value[i];
+        }
+        //higher powers: pk = p^e, term = 1 + p + .. + p^(e-1)
+        long long term = 1 + p;
+        for (long long pk = p * p; ; pk *= p) {
+            first = ((seg_lo + pk - 1) / pk) * pk;
+            long long next_term = term * p + 1;
+            for (long long m = first; m < seg_hi; m += pk) {
+                long long i = m - seg_lo;
+                found[i] *= (unsigned long long)p;
+                if (ctx->fn == ARITH_PHI) value[i] *= p;
+                else if (ctx->fn == ARITH_SIGMA) value[i] = value[i] / term * next_term;
+                else value[i] = 0;
+            }
+            term = next_term;
+            if (pk > last / p) break;
+        }
+    }
+    //one prime factor above sqrt(n) is left unless the product already covers n
+    if (ctx->fn == ARITH_MU || ctx->fn == ARITH_MERTENS) {
+        for (long long i = 0; i < len; ++i) {
+            if (found[i] != (unsigned long long)(seg_lo + i)) value[i] = -value[i];
+        }
+        return;
+    }
+    for (long long i = 0; i < len; ++i) {
+        unsigned long long n = (unsigned long long)(seg_lo + i);
+        if (found[i] == n) continue;
+        long long q = (long long)(n / found[i]);
+        value[i] *= (ctx->fn == ARITH_PHI) ? q - 1 : q + 1;
+    }
+}
+
+//Formats " v" for each value into the text buffer
+static void append_values(TextBuf *out, const long long *value, long long len) {
+    text_reserve(out, (size_t)len * 21);
+    for (long long i = 0; i < len; ++i) {
+        out->len += (size_t)sprintf(out->text + out->len, " %lld", value[i]);
+    }
+}
+
+//Takes one segment once every earlier segment is in (an OrderedFn): chains a
+//Mertens segment onto the running prefix, and prints the listed values
+static void take_segment(void *arg, void *item) {
+    ArithContext *ctx = (ArithContext *)arg;
+    ArithText *t = (ArithText *)item;
+    if (ctx->fn == ARITH_MERTENS) {
+        MertensSegment *all = &ctx->mertens;
+        const MertensSegment *seg = &t->mertens;
+        long long m = all->sum;
+        if (seg->seen) {
+            if (!all->seen || m + seg->max > all->max) { all->max = m + seg->max; all->max_at = seg->max_at; }
+            if (!all->seen || m + seg->min < all->min) { all->min = m + seg->min; all->min_at = seg->min_at; }
+            all->seen = 1;
+        }
+        all->sum = m + seg->sum;
+        for (long long i = 0; i < t->len_mu; ++i) {
+            m += t->mu[i];
+            if (t->lo + i >= ctx->lo) printf(" %lld", m);
+        }
+        free(t->mu);
+    } else {
+        fwrite(t->text.text, 1, t->text.len, stdout);
+        free(t->text.text);
+    }
+    free(t);
+}
+
+static void arith_segment_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    ArithContext *ctx = (ArithContext *)arg;
+    ArithWorker *w = &ctx->workers[thread_id];
+    long long len = hi - lo;
+    if (len <= 0) return;
+    arith_sieve(ctx, w, lo, hi);
+
+    ArithText *out = NULL;
+    if (ctx->fn == ARITH_MERTENS || ctx->list) {
+        out = (ArithText *)calloc(1, sizeof(ArithText));
+        if (!out) {
+            fprintf(stderr, "Error: failed to allocate arithmetic output\n");
+            exit(EXIT_FAILURE);
+        }
+        out->lo = lo;
+    }
+    if (ctx->fn == ARITH_MERTENS) {
+        MertensSegment *m = &out->mertens;
+        long long running = 0;
+        for (long long i = 0; i < len; ++i) {
+            running += w->value[i];
+            if (lo + i < ctx->lo) continue;
+            if (!m->seen || running > m->max) { m->max = running; m->max_at = lo + i; }
+            if (!m->seen || running < m->min) { m->min = running; m->min_at = lo + i; }
+            m->seen = 1;
+        }
+        m->sum = running;
+    } else if (ctx->fn == ARITH_MU) {
+        for (long long i = 0; i < len; ++i) w->mu_count[w->value[i] + 1]++;
+    } else {
+        for (long long i = 0; i < len; ++i) w->sum += (u128)(unsigned long long)w->value[i];
+    }
+
+    if (!out) return;
+    if (ctx->list && ctx->fn == ARITH_MERTENS) {
+        out->mu = (signed char *)malloc((size_t)len);
+        if (!out->mu) {
+            fprintf(stderr, "Error: failed to allocate arithmetic output\n");
+            exit(EXIT_FAILURE);
+        }
+        for (long long i = 0; i < len; ++i) out->mu[i] = (signed char)w->value[i];
+        out->len_mu = len;
+    } else if (ctx->list) {
+        append_values(&out->text, w->value, len);
+    }
+    ordered_put(&ctx->output, index, out);
+}
+
+//Evaluates the selected function on [from, max_value] and prints its summary
+int run_arith(const Options *opts, RunResult *result) {
+    const char *label = arith_name(opts->arith);
+    long long lo = opts->range_lo;
+    long long hi = opts->max_value;
+    //Mertens has to count mu from 1 to know M(lo - 1)
+    long long start = opts->arith == ARITH_MERTENS ? 1 : lo;
+    long long segment = (opts->explicit_params & EXPLICIT_SEGMENT) ? opts->segment_size : ARITH_SEGMENT_SIZE;
+
+    struct Timer my_timer;
+    timer_start(&my_timer);
+
+    phase_begin(PHASE_BASE_SIEVE);
+    long long nodd = 0;
+    long long *odd = sieve_base_primes(isqrt_ll(hi), &nodd);
+    long long nprimes = nodd + 1;
+    long long *primes = (long long *)malloc(sizeof(long long) * (size_t)(nodd + 1));
+    if (!primes) {
+        fprintf(stderr, "Error: failed to allocate base primes\n");
+        exit(EXIT_FAILURE);
+    }
+    mem_track(MEM_BASE_PRIMES, (long long)sizeof(long long) * (nodd + 1));
+    primes[0] = 2;
+    if (nodd) memcpy(primes + 1, odd, sizeof(long long) * (size_t)nodd);
+    free(odd);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nodd);
+    phase_end(PHASE_BASE_SIEVE);
+
+    int nthreads = (int)opts->thread_count;
+    ArithWorker *workers = (ArithWorker *)calloc((size_t)nthreads, sizeof(ArithWorker));
+    if (!workers) {
+        fprintf(stderr, "Error: failed to allocate arithmetic workers\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < nthreads; ++t) {
+        workers[t].value = (long long *)malloc(sizeof(long long) * (size_t)segment);
+        workers[t].found = (unsigned long long *)malloc(sizeof(unsigned long long) * (size_t)segment);
+        if (!workers[t].value || !workers[t].found) {
+            fprintf(stderr, "Error: failed to allocate arithmetic segment buffers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    long long buffer_bytes = (long long)nthreads * segment * (long long)(sizeof(long long) + sizeof(unsigned long long));
+    mem_track(MEM_SEGMENTS, buffer_bytes);
+
+    ArithContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.fn = opts->arith;
+    ctx.lo = lo;
+    ctx.hi = hi;
+    ctx.primes = primes;
+    ctx.nprimes = nprimes;
+    ctx.workers = workers;
+    ctx.list = opts->list;
+    if (ctx.fn == ARITH_MERTENS || ctx.list) ordered_init(&ctx.output, nthreads, take_segment, &ctx);
+    if (ctx.list) printf("[%s] list:", label);
+
+    phase_begin(PHASE_SIEVE);
+    for_each_segment(start, hi + 1, segment, nthreads, arith_segment_fn, &ctx);
+    phase_end(PHASE_SIEVE);
+    double ms = get_time(&my_timer);
+    if (ctx.list) printf("\n");
+
+    char digits[U128_DIGITS + 1];
+    if (ctx.fn == ARITH_MERTENS) {
+        const MertensSegment *all = &ctx.mertens;
+        printf("[%s] M(%lld): %lld\n", label, hi, all->sum);
+        printf("[%s] max over [%lld, %lld]: %lld at %lld\n", label, lo, hi, all->max, all->max_at);
+        printf("[%s] min over [%lld, %lld]: %lld at %lld\n", label, lo, hi, all->min, all->min_at);
+    } else {
+        u128 sum = 0;
+        long long mu_count[3] = { 0, 0, 0 };
+        for (int t = 0; t < nthreads; ++t) {
+            sum += workers[t].sum;
+            for (int c = 0; c < 3; ++c) mu_count[c] += workers[t].mu_count[c];
+        }
+        if (ctx.fn == ARITH_MU) {
+            printf("[%s] sum over [%lld, %lld]: %lld\n", label, lo, hi, mu_count[2] - mu_count[0]);
+            printf("[%s] mu = -1: %lld  0: %lld  1: %lld\n", label, mu_count[0], mu_count[1], mu_count[2]);
+        } else {
+            printf("[%s] sum over [%lld, %lld]: %s\n", label, lo, hi, u128_format(sum, digits));
+        }
+    }
+    printf("[%s] elapsed: %.3f ms\n", label, ms);
+
+    for (int t = 0; t < nthreads; ++t) {
+        free(workers[t].value);
+        free(workers[t].found);
+    }
+    mem_track(MEM_SEGMENTS, -buffer_bytes);
+    free(workers);
+    if (ctx.fn == ARITH_MERTENS || ctx.list) ordered_free(&ctx.output);
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+
+    result->numbers = hi - lo + 1;
+    return EXIT_SUCCESS;
+}
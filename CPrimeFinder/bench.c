@@ -0,0 +1,113 @@
+//
+//  bench.c
+//  CPrimeFinder
+//
+//  In-process benchmark mode: warmup runs, then timed repetitions
+//  summarized with robust statistics.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "pprimes.h"
+
+//qsort comparator for doubles
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+//nearest-rank percentile of an already sorted sample
+static double percentile(const double *sorted, long long n, double pct) {
+    long long rank = (long long)ceil(pct / 100.0 * (double)n);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
+
+//median of an already sorted sample
+static double median(const double *sorted, long long n) {
+    if (n % 2 == 1) return sorted[n / 2];
+    return (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+}
+
+//Sorts the sample in place and returns its median
+double sample_median(double *samples, long long n) {
+    qsort(samples, (size_t)n, sizeof(double), compare_doubles);
+    return median(samples, n);
+}
+
+//Runs the engine warmup + reps times on is_prime_arr, storing the timed runs in samples.
+//Returns 0 if the runs disagree on the prime count.
+int bench_runs(const Options *opts, unsigned char *is_prime_arr, long long warmup, long long reps,
+               double *samples, long long *primes) {
+    size_t bytes = (size_t)(opts->max_value + 1);
+    for (long long i = 0; i < warmup + reps; ++i) {
+        memset(is_prime_arr, 0, bytes);
+
+        struct Timer my_timer;
+        timer_start(&my_timer);
+        run_engine(opts, is_prime_arr);
+        double ms = get_time(&my_timer);
+
+        long long count = count_primes(is_prime_arr, opts->max_value);
+        if (i > 0 && count != *primes) {
+            fprintf(stderr, "Error: run %lld counted %lld primes, expected %lld\n", i, count, *primes);
+            return 0;
+        }
+        *primes = count;
+        if (i >= warmup) samples[i - warmup] = ms;
+    }
+    return 1;
+}
+
+//Runs the selected engine warmup + reps times in this process and reports statistics
+int run_bench(const Options *opts, RunResult *result) {
+    long long reps = opts->bench_reps;
+    result->numbers = opts->max_value * (opts->bench_warmup + reps);
+    double *samples = (double *)malloc(sizeof(double) * (size_t)reps);
+    if (!samples) {
+        fprintf(stderr, "Error: failed to allocate benchmark samples\n");
+        return EXIT_FAILURE;
+    }
+
+    //allocated once so page faults stay out of the measured runs
+    unsigned char *is_prime_arr = alloc_results(opts->max_value);
+    long long primes = 0;
+    if (!bench_runs(opts, is_prime_arr, opts->bench_warmup, reps, samples, &primes)) {
+        free_results(is_prime_arr, opts->max_value);
+        free(samples);
+        return EXIT_FAILURE;
+    }
+    free_results(is_prime_arr, opts->max_value);
+
+    double sum = 0.0;
+    for (long long i = 0; i < reps; ++i) sum += samples[i];
+    double mean = sum / (double)reps;
+    double var = 0.0;
+    for (long long i = 0; i < reps; ++i) var += (samples[i] - mean) * (samples[i] - mean);
+    double stddev = (reps > 1) ? sqrt(var / (double)(reps - 1)) : 0.0;
+
+    double med = sample_median(samples, reps);
+    double med_sec = med / 1000.0;
+
+    const char *label = engine_label(opts);
+    printf("[bench] engine: %s\n", label);
+    printf("[bench] warmup: %lld reps: %lld\n", opts->bench_warmup, reps);
+    printf("[bench] total primes: %lld\n", primes);
+    printf("[bench] min: %.3f ms\n", samples[0]);
+    printf("[bench] median: %.3f ms\n", med);
+    printf("[bench] p95: %.3f ms\n", percentile(samples, reps, 95.0));
+    printf("[bench] mean: %.3f ms\n", mean);
+    printf("[bench] stddev: %.3f ms\n", stddev);
+    if (med_sec > 0.0) {
+        printf("[bench] throughput: %.4e numbers/s, %.4e primes/s\n",
+               (double)(opts->max_value - 1) / med_sec, (double)primes / med_sec);
+    }
+
+    free(samples);
+    return EXIT_SUCCESS;
+}
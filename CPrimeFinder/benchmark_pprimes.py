@@ -1,9 +1,13 @@
 #!/usr/bin/env python3
+import argparse
 import subprocess
 import sys
 import os
-import re
 import csv
+import json
+import math
+import random
+import shutil
 from datetime import datetime
 from pathlib import Path
 
@@ -19,53 +23,289 @@ THREADS = [1, 2, 4, 8, 16, 32, 64]
 TRIALS = 3            # set to 3 (or more) when you want multiple trials
 TIMEOUT_SEC = 3600    # per run cap
 
+# Weak scaling (--weak): N grows with the thread count, N = WEAK_BASE_N * threads
+WEAK_BASE_N = 10000000
+
+# Regression detection (--compare)
+ALPHA = 0.05          # one-sided Mann-Whitney significance level
+THRESHOLD = 0.02      # ignore slowdowns smaller than this fraction of the baseline median
+BOOTSTRAP_ITERS = 2000
+BOOTSTRAP_SEED = 12345
+
 # ------------------------------
-# Helpers (parsing)
+# Helpers (running)
 # ------------------------------
-ELAPSED_RE = re.compile(r'\[(?:sequential|threaded)\]\s+elapsed:\s*([0-9.]+)\s*ms', re.I)
-TOTAL_RE   = re.compile(r'total primes:\s*([0-9]+)', re.I)
+def pin_prefix(t: int, pin: bool):
+    """
+    taskset prefix binding a t-thread run to the first t CPUs this process may use
+    (all of them when t exceeds that), or [] when not pinning.
+    """
+    if not pin:
+        return []
+    allowed = sorted(os.sched_getaffinity(0)) if hasattr(os, "sched_getaffinity") else list(range(os.cpu_count() or 1))
+    cpus = allowed[:max(1, min(t, len(allowed)))]
+    return ["taskset", "-c", ",".join(str(c) for c in cpus)]
 
-def run_once(n: int, t: int):
+def run_record(n: int, t: int, pin: bool = False):
     """
-    Run ./pprimes n t once, parse and return (elapsed_ms, total_primes).
+    Run ./pprimes --report=json --no-profile n t once and return the parsed record
+    (parameters, elapsed_ms, phases_ms, total_primes, peak_rss_bytes, counters).
+    The tuning profile is left out so every run measures the default parameters.
+    With pin, the run is restricted to t CPUs with taskset.
     """
     if not PPRIMES_PATH.exists() or not os.access(PPRIMES_PATH, os.X_OK):
         raise FileNotFoundError(f"Executable not found or not executable: {PPRIMES_PATH}")
+    cmd = pin_prefix(t, pin) + [str(PPRIMES_PATH.resolve()), "--report=json", "--no-profile", str(n), str(t)]
     try:
-        # To suppress printing the prime list in your C, add an env var check (see note below),
-        # then pass env=env with env['PPRIMES_QUIET']='1' here.
-        result = subprocess.run([str(PPRIMES_PATH), str(n), str(t)],
-                                capture_output=True, text=True, timeout=TIMEOUT_SEC)
+        result = subprocess.run(cmd, capture_output=True, text=True, timeout=TIMEOUT_SEC)
     except subprocess.TimeoutExpired:
         raise RuntimeError(f"Timed out: ./pprimes {n} {t}")
 
-    stdout = result.stdout or ""
-    m_time  = ELAPSED_RE.search(stdout)
-    m_total = TOTAL_RE.search(stdout)
-    if m_time is None or m_total is None:
-        debug_path = Path(f"pprimes_output_n{n}_t{t}.txt")
-        debug_path.write_text(stdout)
-        raise RuntimeError(f"Failed to parse output for N={n}, threads={t}. Saved stdout to {debug_path}")
-    return float(m_time.group(1)), int(m_total.group(1))
+    if result.returncode != 0:
+        raise RuntimeError(f"./pprimes {n} {t} exited with {result.returncode}: {result.stderr.strip()}")
+    try:
+        return json.loads(result.stdout)
+    except json.JSONDecodeError as e:
+        raise RuntimeError(f"Bad report for N={n}, threads={t}: {e}")
+
+def memory_of(record):
+    """
+    Memory figures of one run: peak RSS, peak tracked allocations and page faults.
+    """
+    return {
+        "peak_rss_bytes": int(record.get("peak_rss_bytes", -1)),
+        "alloc_peak_bytes": int(record.get("alloc_peak_bytes", {}).get("total", -1)),
+        "minor_faults": int(record.get("minor_faults", -1)),
+        "major_faults": int(record.get("major_faults", -1)),
+    }
+
+def run_once(n: int, t: int, pin: bool = False):
+    """
+    Run ./pprimes n t once and return (elapsed_ms, total_primes, memory).
+    """
+    record = run_record(n, t, pin)
+    return float(record["elapsed_ms"]), int(record["total_primes"]), memory_of(record)
 
-def run_trials(n: int, t: int, trials: int):
+def run_trials(n: int, t: int, trials: int, pin: bool = False):
     """
-    Returns (avg_ms, total_primes_from_last, times_ms_list)
+    Returns (avg_ms, total_primes_from_last, times_ms_list, memory) where memory
+    holds the largest value of each memory figure across the trials.
     """
     times_ms = []
     total_last = None
+    memory = {}
     for i in range(trials):
-        elapsed_ms, total = run_once(n, t)
+        elapsed_ms, total, mem = run_once(n, t, pin)
         times_ms.append(elapsed_ms)
         total_last = total
-        print(f"N={n}, T={t}, trial {i+1}/{trials}: {elapsed_ms:.3f} ms (total primes {total})")
+        for k, v in mem.items():
+            memory[k] = max(memory.get(k, v), v)
+        print(f"N={n}, T={t}, trial {i+1}/{trials}: {elapsed_ms:.3f} ms (total primes {total}, "
+              f"peak RSS {mem['peak_rss_bytes'] / 2**20:.1f} MiB)")
     avg_ms = sum(times_ms) / len(times_ms)
-    return avg_ms, total_last, times_ms
+    return avg_ms, total_last, times_ms, memory
+
+MEMORY_COLS = ["peak_rss_bytes", "alloc_peak_bytes", "minor_faults", "major_faults"]
+
+# ------------------------------
+# Scaling metrics
+# ------------------------------
+def efficiency(speedup: float, p: int):
+    """
+    Parallel efficiency S/p.
+    """
+    return speedup / p if math.isfinite(speedup) else float("nan")
+
+def karp_flatt(speedup: float, p: int):
+    """
+    Karp-Flatt experimentally determined serial fraction e = (1/S - 1/p) / (1 - 1/p).
+    A value that grows with p points at parallel overhead rather than a fixed serial part.
+    """
+    if p <= 1 or not math.isfinite(speedup) or speedup <= 0:
+        return float("nan")
+    return (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p)
+
+def run_weak_scaling(outdir: Path, pin: bool):
+    """
+    Weak scaling: N = WEAK_BASE_N * threads, so the work per thread stays roughly fixed.
+    Writes weak_scaling.csv and weak_efficiency.png; efficiency is T(1, N0) / T(p, p*N0).
+    Sieve work grows as N log log N, so even perfect scaling lands slightly below 1.
+    """
+    rows = []
+    base_ms = None
+    for t in THREADS:
+        n = WEAK_BASE_N * t
+        try:
+            avg_ms, total_primes, _, memory = run_trials(n, t, TRIALS, pin)
+        except Exception as e:
+            print(f"WARNING: failed (N={n}, T={t}): {e}", file=sys.stderr)
+            avg_ms, total_primes, memory = float("nan"), -1, {}
+        if t == 1 and math.isfinite(avg_ms):
+            base_ms = avg_ms
+        eff = (base_ms / avg_ms) if (base_ms and math.isfinite(avg_ms) and avg_ms > 0) else float("nan")
+        rows.append({"N": n, "threads": t, "trials": TRIALS, "avg_ms": avg_ms,
+                     "weak_efficiency": eff, "total_primes": total_primes,
+                     **{k: memory.get(k, "") for k in MEMORY_COLS}})
+
+    csv_path = outdir / "weak_scaling.csv"
+    with open(csv_path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=["N", "threads", "trials", "avg_ms", "weak_efficiency",
+                                               "total_primes"] + MEMORY_COLS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"Wrote CSV: {csv_path}")
+
+    plt.figure()
+    plt.plot([r["threads"] for r in rows], [r["weak_efficiency"] for r in rows], marker="o", label="measured")
+    plt.axhline(1.0, color="gray", linestyle="--", label="ideal")
+    plt.title(f"Weak Scaling Efficiency (N = {WEAK_BASE_N:.0e} × threads)")
+    plt.xlabel("Threads")
+    plt.ylabel("Efficiency T1 / Tp")
+    plt.grid(True, linestyle=":")
+    plt.xscale("log", base=2)
+    plt.ylim(bottom=0)
+    plt.legend()
+    plt.savefig(outdir / "weak_efficiency.png", dpi=150, bbox_inches="tight")
+    plt.close()
+
+# ------------------------------
+# Regression detection
+# ------------------------------
+def load_trials(path: Path):
+    """
+    Load per-trial times in ms keyed by (N, threads) from a pprimes_bench.csv
+    (trial_k_ms columns) or pprimes_bench_seconds.csv (trial_k_s columns).
+    """
+    trials = {}
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            times = []
+            for col, val in row.items():
+                if not col.startswith("trial_") or val in ("", None):
+                    continue
+                v = float(val)
+                if not math.isfinite(v):
+                    continue
+                times.append(v * 1000.0 if col.endswith("_s") else v)
+            if times:
+                trials[(int(row["N"]), int(row["threads"]))] = times
+    return trials
+
+def _u_counts(n: int, m: int):
+    """
+    Number of rankings giving each Mann-Whitney U value for samples of size n and m (no ties).
+    """
+    # counts[j][u]: arrangements of n items of the first sample and j of the second
+    prev = [[1]] + [None] * m
+    for j in range(1, m + 1):
+        prev[j] = [1]
+    for i in range(1, n + 1):
+        cur = [[1]] + [None] * m
+        for j in range(1, m + 1):
+            a = prev[j]                      # last item from sample 1: adds j to U
+            b = cur[j - 1]                   # last item from sample 2: adds nothing
+            size = max(len(a) + j, len(b))
+            out = [0] * size
+            for u, c in enumerate(a):
+                out[u + j] += c
+            for u, c in enumerate(b):
+                out[u] += c
+            cur[j] = out
+        prev = cur
+    return prev[m]
+
+def mann_whitney_greater(current, baseline):
+    """
+    One-sided Mann-Whitney U test that `current` tends to be larger than `baseline`.
+    Exact for small tie-free samples, normal approximation with tie correction otherwise.
+    """
+    n, m = len(current), len(baseline)
+    u = 0.0
+    for c in current:
+        for b in baseline:
+            u += 1.0 if c > b else (0.5 if c == b else 0.0)
+    ties = len(set(current) | set(baseline)) < n + m
+    if not ties and n <= 20 and m <= 20:
+        counts = _u_counts(n, m)
+        total = sum(counts)
+        return u, sum(counts[int(u):]) / total
+    combined = sorted(current + baseline)
+    tie_term = 0.0
+    i = 0
+    while i < len(combined):
+        j = i
+        while j < len(combined) and combined[j] == combined[i]:
+            j += 1
+        t = j - i
+        tie_term += t ** 3 - t
+        i = j
+    nm = n + m
+    mean = n * m / 2.0
+    var = n * m / 12.0 * ((nm + 1) - tie_term / (nm * (nm - 1)))
+    if var <= 0:
+        return u, 1.0
+    z = (u - mean - 0.5) / math.sqrt(var)
+    return u, 0.5 * math.erfc(z / math.sqrt(2.0))
+
+def _median(xs):
+    s = sorted(xs)
+    k = len(s)
+    return s[k // 2] if k % 2 else (s[k // 2 - 1] + s[k // 2]) / 2.0
+
+def bootstrap_delta_ci(current, baseline, iters=BOOTSTRAP_ITERS, seed=BOOTSTRAP_SEED, level=0.95):
+    """
+    Percentile bootstrap CI of the relative change in median time (current / baseline - 1).
+    """
+    rng = random.Random(seed)
+    deltas = []
+    for _ in range(iters):
+        c = [rng.choice(current) for _ in current]
+        b = [rng.choice(baseline) for _ in baseline]
+        mb = _median(b)
+        if mb > 0:
+            deltas.append(_median(c) / mb - 1.0)
+    deltas.sort()
+    if not deltas:
+        return float("nan"), float("nan")
+    lo = deltas[int((1.0 - level) / 2.0 * (len(deltas) - 1))]
+    hi = deltas[int((1.0 + level) / 2.0 * (len(deltas) - 1))]
+    return lo, hi
+
+def compare_runs(baseline_path: Path, current_path: Path, alpha=ALPHA, threshold=THRESHOLD):
+    """
+    Compare per-(N, threads) trial times of two benchmark CSVs. Prints one line per
+    configuration and returns the list of (N, threads) that regressed significantly.
+    """
+    baseline = load_trials(baseline_path)
+    current = load_trials(current_path)
+    regressions = []
+    print(f"Comparing {current_path} against baseline {baseline_path}")
+    print(f"{'N':>12} {'threads':>7} {'base ms':>12} {'cur ms':>12} {'delta':>8} {'95% CI':>19} {'p':>8}  verdict")
+    for key in sorted(set(baseline) & set(current)):
+        b, c = baseline[key], current[key]
+        mb, mc = _median(b), _median(c)
+        delta = (mc / mb - 1.0) if mb > 0 else float("nan")
+        lo, hi = bootstrap_delta_ci(c, b)
+        _, p = mann_whitney_greater(c, b)
+        slower = p <= alpha and delta > threshold
+        verdict = "REGRESSION" if slower else ("faster" if delta < -threshold else "ok")
+        if slower:
+            regressions.append(key)
+        print(f"{key[0]:>12} {key[1]:>7} {mb:>12.3f} {mc:>12.3f} {delta:>+8.1%} "
+              f"[{lo:>+7.1%}, {hi:>+7.1%}] {p:>8.4f}  {verdict}")
+    for key in sorted(set(baseline) ^ set(current)):
+        where = "baseline" if key in baseline else "current"
+        print(f"{key[0]:>12} {key[1]:>7}  only in {where} results, skipped")
+    print(f"{len(regressions)} significant regression(s) (alpha={alpha}, threshold={threshold:.0%})")
+    return regressions
 
 # ------------------------------
 # Main
 # ------------------------------
-def main():
+def main(pin: bool = False, weak: bool = False):
+    if pin and shutil.which("taskset") is None:
+        print("Warning: taskset not found; running unpinned.", file=sys.stderr)
+        pin = False
     if not PPRIMES_PATH.exists():
         print(f"Error: {PPRIMES_PATH} not found. Place 'pprimes' next to this script.", file=sys.stderr)
         sys.exit(1)
@@ -75,7 +315,7 @@ def main():
 
     ts = datetime.now().strftime("%Y%m%d_%H%M%S")
     outdir = Path(f"./trial_data/trial_data_{ts}")
-    outdir.mkdir(exist_ok=True)
+    outdir.mkdir(parents=True, exist_ok=True)
 
     # Collect data
     rows = []
@@ -83,10 +323,10 @@ def main():
     for n in NS:
         for t in THREADS:
             try:
-                avg_ms, total_primes, times_ms = run_trials(n, t, TRIALS)
+                avg_ms, total_primes, times_ms, memory = run_trials(n, t, TRIALS, pin)
             except Exception as e:
                 print(f"WARNING: failed (N={n}, T={t}): {e}", file=sys.stderr)
-                avg_ms, total_primes, times_ms = float('nan'), -1, []
+                avg_ms, total_primes, times_ms, memory = float('nan'), -1, [], {}
             rows.append({
                 "N": n,
                 "threads": t,
@@ -94,6 +334,7 @@ def main():
                 "avg_ms": avg_ms,
                 "avg_sec": (avg_ms / 1000.0) if avg_ms == avg_ms else float('nan'),
                 "total_primes": total_primes,
+                **{k: memory.get(k, float("nan")) for k in MEMORY_COLS},
             })
             trials_map[(n, t)] = times_ms
 
@@ -108,23 +349,28 @@ def main():
         n, t = r["N"], r["threads"]
         base = base_ms_by_n.get(n)
         r["speedup"] = (base / r["avg_ms"]) if (base and r["avg_ms"] and r["avg_ms"] == r["avg_ms"] and r["avg_ms"] > 0) else float("nan")
+        r["efficiency"] = efficiency(r["speedup"], t)
+        r["karp_flatt"] = karp_flatt(r["speedup"], t)
 
     # Save CSV with per-trial columns too
     trial_cols = [f"trial_{i+1}_ms" for i in range(TRIALS)]
     csv_path = outdir / "pprimes_bench.csv"
     with open(csv_path, "w", newline="") as f:
-        fieldnames = ["N", "threads", "trials"] + trial_cols + ["avg_ms", "avg_sec", "speedup", "total_primes"]
+        fieldnames = ["N", "threads", "trials"] + trial_cols + ["avg_ms", "avg_sec", "speedup", "efficiency",
+                                                                "karp_flatt", "total_primes"] + MEMORY_COLS
         writer = csv.DictWriter(f, fieldnames=fieldnames)
         writer.writeheader()
         for r in rows:
             n, t = r["N"], r["threads"]
-            rec = {k: r.get(k) for k in ["N", "threads", "trials", "avg_ms", "avg_sec", "speedup", "total_primes"]}
+            rec = {k: r.get(k) for k in ["N", "threads", "trials", "avg_ms", "avg_sec", "speedup", "efficiency",
+                                         "karp_flatt", "total_primes"] + MEMORY_COLS}
             # fill per-trial
             times = trials_map.get((n, t), [])
             for i in range(TRIALS):
                 rec[f"trial_{i+1}_ms"] = times[i] if i < len(times) else ""
             writer.writerow(rec)
     print(f"Wrote CSV: {csv_path}")
+    bench_csv_path = csv_path
 
     df = pd.DataFrame(rows)
 
@@ -187,6 +433,53 @@ def main():
     plt.savefig(outdir / "speedup_vs_problem_size_all_threads.png", dpi=150, bbox_inches="tight")
     plt.close()
 
+    # ------------------------------
+    # Plot 4: Strong-scaling efficiency and Karp-Flatt serial fraction vs threads
+    # ------------------------------
+    fig, (ax_eff, ax_kf) = plt.subplots(1, 2, figsize=(12, 4.5))
+    for n in NS:
+        df_n = df[df["N"] == n].sort_values("threads")
+        if df_n.empty or df_n["efficiency"].isna().all():
+            continue
+        ax_eff.plot(df_n["threads"], df_n["efficiency"], marker="o", label=f"N={n:.0e}")
+        df_kf = df_n[df_n["threads"] > 1]
+        ax_kf.plot(df_kf["threads"], df_kf["karp_flatt"], marker="o", label=f"N={n:.0e}")
+    ax_eff.axhline(1.0, color="gray", linestyle="--")
+    ax_eff.set_title("Parallel Efficiency (T1 / (p · Tp))")
+    ax_eff.set_ylabel("Efficiency")
+    ax_kf.set_title("Karp-Flatt Serial Fraction")
+    ax_kf.set_ylabel("e")
+    for ax in (ax_eff, ax_kf):
+        ax.set_xlabel("Threads")
+        ax.set_xscale("log", base=2)
+        ax.grid(True, linestyle=":")
+    ax_eff.legend(fontsize=8)
+    fig.savefig(outdir / "efficiency_vs_threads.png", dpi=150, bbox_inches="tight")
+    plt.close(fig)
+
+    # ------------------------------
+    # Plot 5: Peak RSS and tracked allocations vs Problem Size
+    # ------------------------------
+    fig, ax = plt.subplots()
+    for t in THREADS:
+        df_t = df[df["threads"] == t].sort_values("N")
+        label = "Sequential" if t == 1 else f"{t} threads"
+        ax.plot(df_t["N"], df_t["peak_rss_bytes"] / 2**20, marker="o", label=f"{label} (RSS)")
+    df_1 = df[df["threads"] == THREADS[0]].sort_values("N")
+    ax.plot(df_1["N"], df_1["alloc_peak_bytes"] / 2**20, color="black", linestyle="--", label="tracked allocations")
+    ax.set_title("Peak Memory vs Problem Size")
+    ax.set_xlabel("Input Number")
+    ax.set_ylabel("MiB (log scale)")
+    ax.set_xscale("log")
+    ax.set_yscale("log")
+    ax.grid(True, linestyle=":")
+    ax.legend(fontsize=8)
+    fig.savefig(outdir / "memory_vs_problem_size.png", dpi=150, bbox_inches="tight")
+    plt.close(fig)
+
+    if weak:
+        run_weak_scaling(outdir, pin)
+
     # ---------------------------------------------
     # CSV (seconds columns) + Display Table (sci notation, 3 decimals)
     # ---------------------------------------------
@@ -321,6 +614,26 @@ def main():
     print(f"Wrote table image: {png_table}")
     
     print("Done.")
+    return bench_csv_path
 
 if __name__ == "__main__":
-    main()
+    parser = argparse.ArgumentParser(description="Benchmark ./pprimes and optionally gate on regressions.")
+    parser.add_argument("--compare", metavar="BASELINE_CSV", type=Path,
+                        help="compare against a baseline pprimes_bench.csv; exit 1 on a significant slowdown")
+    parser.add_argument("--current", metavar="CURRENT_CSV", type=Path,
+                        help="with --compare, use this CSV instead of running a new benchmark")
+    parser.add_argument("--pin", action="store_true",
+                        help="pin each k-thread run to k CPUs with taskset")
+    parser.add_argument("--weak", action="store_true",
+                        help=f"also run a weak-scaling study (N = {WEAK_BASE_N} x threads)")
+    parser.add_argument("--alpha", type=float, default=ALPHA, help="significance level (default %(default)s)")
+    parser.add_argument("--threshold", type=float, default=THRESHOLD,
+                        help="minimum relative slowdown to flag (default %(default)s)")
+    args = parser.parse_args()
+
+    if args.compare is None:
+        main(args.pin, args.weak)
+    else:
+        current_csv = args.current if args.current is not None else main(args.pin, args.weak)
+        regressed = compare_runs(args.compare, current_csv, args.alpha, args.threshold)
+        sys.exit(1 if regressed else 0)
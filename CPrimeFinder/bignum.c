@@ -0,0 +1,702 @@
+//
+//  bignum.c
+//  CPrimeFinder
+//
+//  Probable-prime testing of numbers of any size (--test). A number is an
+//  array of 64-bit limbs, least significant first, as long as the modulus.
+//  Products switch from schoolbook to Karatsuba at BN_KARATSUBA_THRESHOLD
+//  limbs. Montgomery reduction goes limb by limb below BN_REDC_THRESHOLD and
+//  takes two full products above it, so that both halves of a modular
+//  multiply get the Karatsuba speed-up. Powers use a sliding window of odd
+//  powers. The test is the Baillie-PSW of is_prime_u128 at full size: trial
+//  division, a strong base-2 test and a strong Lucas test. `--test bench`
+//  times modular exponentiation by operand size.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+typedef unsigned long long Limb;
+
+#define BN_KARATSUBA_THRESHOLD 24
+#define BN_REDC_THRESHOLD 256
+#define BN_TRIAL_LIMIT 2048
+#define BN_BENCH_MS 250.0
+//scratch for bn_mul_n: 6 limbs per limb of operand halved at every level, plus rounding
+#define BN_MUL_SCRATCH(n) (6 * (n) + 512)
+
+//d divides a group's remainder mod product exactly when it divides the number
+typedef struct {
+    Limb product;             // of the odd primes[first, first + count), below 2^64
+    int first;
+    int count;
+} TrialGroup;
+
+static Limb *trial_primes;
+static TrialGroup *trial_groups;
+static int ngroups;
+static pthread_once_t trial_once = PTHREAD_ONCE_INIT;
+
+//Montgomery form mod an odd n of k limbs with R = 2^(64k)
+typedef struct {
+    int k;
+    Limb *n;
+    Limb ninv0;               // -n^-1 mod 2^64
+    Limb *ninv;               // -n^-1 mod R, for the reduction by full products
+    Limb *one;                // R mod n
+    Limb *r2;                 // R^2 mod n
+    Limb *prod;               // 2k + 1 limbs for the product being reduced
+    Limb *tmp;                // 3k limbs for the reduction by full products
+    Limb *scratch;            // BN_MUL_SCRATCH(k) limbs for bn_mul_n
+    long long bytes;
+} BnMont;
+
+static void build_trial_groups(void) {
+    long long n = 0;
+    long long *primes = sieve_base_primes(BN_TRIAL_LIMIT, &n);
+    trial_primes = (Limb *)malloc(sizeof(Limb) * (size_t)n);
+    trial_groups = (TrialGroup *)malloc(sizeof(TrialGroup) * (size_t)n);
+    if (!trial_primes || !trial_groups) {
+        fprintf(stderr, "Error: failed to allocate the trial division table\n");
+        exit(EXIT_FAILURE);
+    }
+    //sieve_base_primes gives the odd primes only, which is all we need: the caller has ruled out even numbers
+    int count = 0;
+    for (long long i = 0; i < n; ++i) trial_primes[count++] = (Limb)primes[i];
+    for (int i = 0; i < count;) {
+        TrialGroup *g = &trial_groups[ngroups++];
+        g->product = 1;
+        g->first = i;
+        g->count = 0;
+        while (i < count && g->product <= ~0ULL / trial_primes[i]) {
+            g->product *= trial_primes[i++];
+            g->count++;
+        }
+    }
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * n);
+}
+
+static Limb bn_add_n(Limb *r, const Limb *a, const Limb *b, int n) {
+    Limb carry = 0;
+    for (int i = 0; i < n; ++i) {
+        u128 s = (u128)a[i] + b[i] + carry;
+        r[i] = (Limb)s;
+        carry = (Limb)(s >> 64);
+    }
+    return carry;
+}
+
+//r = a + b for b no longer than a; returns the carry out
+static Limb bn_add(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+    Limb carry = bn_add_n(r, a, b, bn);
+    for (int i = bn; i < an; ++i) {
+        r[i] = a[i] + carry;
+        carry = r[i] < carry;
+    }
+    return carry;
+}
+
+static Limb bn_sub_n(Limb *r, const Limb *a, const Limb *b, int n) {
+    Limb borrow = 0;
+    for (int i = 0; i < n; ++i) {
+        Limb x = a[i], y = b[i];
+        r[i] = x - y - borrow;
+        borrow = (x < y) || (x - y < borrow);
+    }
+    return borrow;
+}
+
+static Limb bn_sub(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+    Limb borrow = bn_sub_n(r, a, b, bn);
+    for (int i = bn; i < an; ++i) {
+        Limb x = a[i];
+        r[i] = x - borrow;
+        borrow = x < borrow;
+    }
+    return borrow;
+}
+
+static int bn_cmp(const Limb *a, const Limb *b, int n) {
+    for (int i = n - 1; i >= 0; --i) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static int bn_is_zero(const Limb *a, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (a[i]) return 0;
+    }
+    return 1;
+}
+
+static int bn_bit(const Limb *a, long long i) {
+    return (int)((a[i / 64] >> (i % 64)) & 1);
+}
+
+static long long bn_bit_length(const Limb *a, int n) {
+    while (n > 0 && a[n - 1] == 0) n--;
+    return n ? 64LL * n - __builtin_clzll(a[n - 1]) : 0;
+}
+
+static long long bn_ctz(const Limb *a, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (a[i]) return 64LL * i + __builtin_ctzll(a[i]);
+    }
+    return 64LL * n;
+}
+
+//r = a >> s over n limbs; r may be a
+static void bn_shr(Limb *r, const Limb *a, int n, long long s) {
+    int limbs = (int)(s / 64), bits = (int)(s % 64);
+    for (int i = 0; i < n; ++i) {
+        Limb lo = i + limbs < n ? a[i + limbs] : 0;
+        Limb hi = i + limbs + 1 < n ? a[i + limbs + 1] : 0;
+        r[i] = bits ? (lo >> bits) | (hi << (64 - bits)) : lo;
+    }
+}
+
+//r += a * q over n limbs; returns the carry out
+static Limb bn_addmul_1(Limb *r, const Limb *a, int n, Limb q) {
+    Limb carry = 0;
+    for (int i = 0; i < n; ++i) {
+        u128 t = (u128)a[i] * q + r[i] + carry;
+        r[i] = (Limb)t;
+        carry = (Limb)(t >> 64);
+    }
+    return carry;
+}
+
+static Limb bn_mod_1(const Limb *a, int n, Limb d) {
+    Limb r = 0;
+    for (int i = n - 1; i >= 0; --i) r = (Limb)((((u128)r << 64) | a[i]) % d);
+    return r;
+}
+
+//r (an + bn limbs) = a * b
+static void bn_mul_basecase(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+    memset(r, 0, sizeof(Limb) * (size_t)(an + bn));
+    for (int j = 0; j < bn; ++j) r[an + j] = bn_addmul_1(r + j, a, an, b[j]);
+}
+
+//d = |x - y| for x of l limbs and y of h <= l limbs; returns 1 when y > x
+static int bn_absdiff(Limb *d, const Limb *x, int l, const Limb *y, int h) {
+    int i = l - 1;
+    while (i >= h && x[i] == 0) i--;
+    int y_larger = i < h && bn_cmp(x, y, h) < 0;
+    if (y_larger) {
+        bn_sub_n(d, y, x, h);
+        memset(d + h, 0, sizeof(Limb) * (size_t)(l - h));
+    } else {
+        bn_sub(d, x, l, y, h);
+    }
+    return y_larger;
+}
+
+//r (2n limbs) = a * b with Karatsuba's three half-size products:
+//a0 b1 + a1 b0 = a0 b0 + a1 b1 - (a0 - a1)(b0 - b1)
+static void bn_mul_n(Limb *r, const Limb *a, const Limb *b, int n, Limb *scratch) {
+    if (n < BN_KARATSUBA_THRESHOLD) {
+        bn_mul_basecase(r, a, n, b, n);
+        return;
+    }
+    int l = (n + 1) / 2, h = n - l;
+    Limb *da = scratch, *db = da + l, *m = db + l, *t = m + 2 * l, *rest = t + 2 * l + 1;
+    int negative = bn_absdiff(da, a, l, a + l, h) ^ bn_absdiff(db, b, l, b + l, h);
+    bn_mul_n(r, a, b, l, rest);
+    bn_mul_n(r + 2 * l, a + l, b + l, h, rest);
+    bn_mul_n(m, da, db, l, rest);
+    memcpy(t, r, sizeof(Limb) * (size_t)(2 * l));
+    t[2 * l] = bn_add(t, t, 2 * l, r + 2 * l, 2 * h);
+    if (negative) {
+        bn_add(t, t, 2 * l + 1, m, 2 * l);
+    } else {
+        bn_sub(t, t, 2 * l + 1, m, 2 * l);
+    }
+    bn_add(r + l, r + l, 2 * n - l, t, 2 * l + 1);
+}
+
+//r = t / R mod n for t < n R in 2k limbs, which are overwritten
+static void bn_redc(const BnMont *m, Limb *r, Limb *t) {
+    int k = m->k;
+    Limb top = 0;
+    if (k < BN_REDC_THRESHOLD) {
+        //clear one low limb at a time by adding a multiple of n
+        for (int i = 0; i < k; ++i) {
+            Limb carry = bn_addmul_1(t + i, m->n, k, t[i] * m->ninv0);
+            for (int j = i + k; carry && j < 2 * k; ++j) {
+                t[j] += carry;
+                carry = t[j] < carry;
+            }
+            top += carry;
+        }
+    } else {
+        //q = t * (-n^-1) mod R, then t + q n is a multiple of R
+        Limb *q = m->tmp, *qn = m->tmp + k;
+        bn_mul_n(qn, t, m->ninv, k, m->scratch);
+        memcpy(q, qn, sizeof(Limb) * (size_t)k);
+        bn_mul_n(qn, q, m->n, k, m->scratch);
+        top = bn_add_n(t, t, qn, 2 * k);
+    }
+    if (top || bn_cmp(t + k, m->n, k) >= 0) {
+        bn_sub_n(r, t + k, m->n, k);
+    } else {
+        memcpy(r, t + k, sizeof(Limb) * (size_t)k);
+    }
+}
+
+static void bn_mont_mul(const BnMont *m, Limb *r, const Limb *a, const Limb *b) {
+    bn_mul_n(m->prod, a, b, m->k, m->scratch);
+    bn_redc(m, r, m->prod);
+}
+
+static void bn_mod_add(const BnMont *m, Limb *r, const Limb *a, const Limb *b) {
+    if (bn_add_n(r, a, b, m->k) || bn_cmp(r, m->n, m->k) >= 0) bn_sub_n(r, r, m->n, m->k);
+}
+
+static void bn_mod_sub(const BnMont *m, Limb *r, const Limb *a, const Limb *b) {
+    if (bn_sub_n(r, a, b, m->k)) bn_add_n(r, r, m->n, m->k);
+}
+
+//r = a / 2 mod n, which Montgomery form leaves alone
+static void bn_mod_half(const BnMont *m, Limb *r, const Limb *a) {
+    int k = m->k;
+    Limb carry = 0;
+    if (a[0] & 1) {
+        carry = bn_add_n(r, a, m->n, k);
+    } else if (r != a) {
+        memcpy(r, a, sizeof(Limb) * (size_t)k);
+    }
+    bn_shr(r, r, k, 1);
+    r[k - 1] |= carry << 63;
+}
+
+//Montgomery form of a < n
+static void bn_mont_to(const BnMont *m, Limb *r, const Limb *a) {
+    bn_mont_mul(m, r, a, m->r2);
+}
+
+static void bn_mont_init(BnMont *m, const Limb *n, int k) {
+    m->k = k;
+    size_t limbs = (size_t)(4 * k + (2 * k + 1) + 3 * k + BN_MUL_SCRATCH(k));
+    Limb *mem = (Limb *)calloc(limbs, sizeof(Limb));
+    if (!mem) {
+        fprintf(stderr, "Error: failed to allocate a %d-limb Montgomery context\n", k);
+        exit(EXIT_FAILURE);
+    }
+    m->bytes = (long long)(limbs * sizeof(Limb));
+    mem_track(MEM_RESULTS, m->bytes);
+    m->n = mem;
+    m->ninv = m->n + k;
+    m->one = m->ninv + k;
+    m->r2 = m->one + k;
+    m->prod = m->r2 + k;
+    m->tmp = m->prod + 2 * k + 1;
+    m->scratch = m->tmp + 3 * k;
+    memcpy(m->n, n, sizeof(Limb) * (size_t)k);
+
+    //Newton's iteration doubles the correct low bits; n is its own inverse mod 8
+    Limb inv = n[0];
+    for (int i = 0; i < 5; ++i) inv *= 2 - n[0] * inv;
+    m->ninv0 = 0 - inv;
+    if (k >= BN_REDC_THRESHOLD) {
+        //the limbs q_i that clear 1 + n q one limb at a time make up -n^-1 mod R
+        Limb *acc = m->prod;
+        memset(acc, 0, sizeof(Limb) * (size_t)k);
+        acc[0] = 1;
+        for (int i = 0; i < k; ++i) {
+            m->ninv[i] = acc[i] * m->ninv0;
+            bn_addmul_1(acc + i, n, k - i, m->ninv[i]);
+        }
+    }
+
+    //R mod n and R^2 mod n by doubling, since nothing here divides
+    Limb *x = m->one;
+    x[0] = 1;
+    for (long long i = 0; i < 128LL * k; ++i) {
+        Limb carry = bn_add_n(x, x, x, k);
+        if (carry || bn_cmp(x, n, k) >= 0) bn_sub_n(x, x, n, k);
+        if (i == 64LL * k - 1) x = (Limb *)memcpy(m->r2, m->one, sizeof(Limb) * (size_t)k);
+    }
+}
+
+static void bn_mont_free(BnMont *m) {
+    free(m->n);
+    mem_track(MEM_RESULTS, -m->bytes);
+    m->n = NULL;
+}
+
+//Window width that minimizes multiplies for an exponent of this many bits
+static int bn_window_bits(long long bits) {
+    if (bits > 671) return 6;
+    if (bits > 239) return 5;
+    if (bits > 79) return 4;
+    if (bits > 23) return 3;
+    return 1;
+}
+
+//r = base^e with base and r in Montgomery form, e of en limbs
+static void bn_mont_pow(const BnMont *m, Limb *r, const Limb *base, const Limb *e, int en) {
+    int k = m->k;
+    long long bits = bn_bit_length(e, en);
+    int w = bn_window_bits(bits);
+    //table[i] = base^(2i + 1)
+    Limb *table = (Limb *)malloc(sizeof(Limb) * (size_t)k * ((size_t)1 << (w - 1)));
+    Limb *square = (Limb *)malloc(sizeof(Limb) * (size_t)k);
+    if (!table || !square) {
+        fprintf(stderr, "Error: failed to allocate the power table\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(table, base, sizeof(Limb) * (size_t)k);
+    bn_mont_mul(m, square, base, base);
+    for (int i = 1; i < (1 << (w - 1)); ++i) bn_mont_mul(m, table + (size_t)i * k, table + (size_t)(i - 1) * k, square);
+
+    memcpy(r, m->one, sizeof(Limb) * (size_t)k);
+    int started = 0;
+    for (long long i = bits - 1; i >= 0;) {
+        if (!bn_bit(e, i)) {
+            if (started) bn_mont_mul(m, r, r, r);
+            i--;
+            continue;
+        }
+        //the longest window of at most w bits from i that ends in a 1
+        long long j = i - w + 1 < 0 ? 0 : i - w + 1;
+        while (!bn_bit(e, j)) j++;
+        int value = 0;
+        for (long long b = i; b >= j; --b) value = (value << 1) | bn_bit(e, b);
+        if (started) {
+            for (long long b = i; b >= j; --b) bn_mont_mul(m, r, r, r);
+            bn_mont_mul(m, r, r, table + (size_t)(value >> 1) * k);
+        } else {
+            memcpy(r, table + (size_t)(value >> 1) * k, sizeof(Limb) * (size_t)k);
+            started = 1;
+        }
+        i = j - 1;
+    }
+    free(table);
+    free(square);
+}
+
+//Jacobi symbol (a / n) for odd n
+static int jacobi_u64(Limb a, Limb n) {
+    int t = 1;
+    a %= n;
+    while (a) {
+        int z = __builtin_ctzll(a);
+        a >>= z;
+        if ((z & 1) && ((n & 7) == 3 || (n & 7) == 5)) t = -t;
+        if ((a & 3) == 3 && (n & 3) == 3) t = -t;
+        Limb r = n % a;
+        n = a;
+        a = r;
+    }
+    return n == 1 ? t : 0;
+}
+
+//(D / n) for odd n and small odd D, by reciprocity from n mod |D|
+static int bn_jacobi_small(long long D, const Limb *n, int k) {
+    Limb a = (Limb)(D < 0 ? -D : D);
+    int t = jacobi_u64(bn_mod_1(n, k, a), a);
+    if ((a & 3) == 3 && (n[0] & 3) == 3) t = -t;
+    if (D < 0 && (n[0] & 3) == 3) t = -t;
+    return t;
+}
+
+//Bit-by-bit integer square root, which needs no division
+static int bn_is_square(const Limb *n, int k) {
+    Limb *x = (Limb *)calloc((size_t)(4 * k), sizeof(Limb));
+    if (!x) {
+        fprintf(stderr, "Error: failed to allocate the square root\n");
+        exit(EXIT_FAILURE);
+    }
+    Limb *root = x + k, *bit = root + k, *sum = bit + k;
+    memcpy(x, n, sizeof(Limb) * (size_t)k);
+    long long top = (bn_bit_length(n, k) - 1) & ~1LL;
+    bit[top / 64] = 1ULL << (top % 64);
+    while (!bn_is_zero(bit, k)) {
+        bn_add_n(sum, root, bit, k);
+        bn_shr(root, root, k, 1);
+        if (bn_cmp(x, sum, k) >= 0) {
+            bn_sub_n(x, x, sum, k);
+            bn_add_n(root, root, bit, k);
+        }
+        bn_shr(bit, bit, k, 2);
+    }
+    int square = bn_is_zero(x, k);
+    free(x);
+    return square;
+}
+
+//Strong probable-prime test of m->n to base 2
+static int bn_strong_base2(const BnMont *m) {
+    int k = m->k;
+    Limb *d = (Limb *)malloc(sizeof(Limb) * (size_t)(4 * k));
+    if (!d) {
+        fprintf(stderr, "Error: failed to allocate the base-2 test\n");
+        exit(EXIT_FAILURE);
+    }
+    Limb *x = d + k, *two = x + k, *minus_one = two + k;
+    memcpy(d, m->n, sizeof(Limb) * (size_t)k);
+    d[0]--;
+    long long s = bn_ctz(d, k);
+    bn_shr(d, d, k, s);
+    bn_mod_add(m, two, m->one, m->one);
+    bn_sub_n(minus_one, m->n, m->one, k);
+    bn_mont_pow(m, x, two, d, k);
+    int probable = bn_cmp(x, m->one, k) == 0 || bn_cmp(x, minus_one, k) == 0;
+    for (long long i = 1; i < s && !probable; ++i) {
+        bn_mont_mul(m, x, x, x);
+        probable = bn_cmp(x, minus_one, k) == 0;
+    }
+    free(d);
+    return probable;
+}
+
+//Strong Lucas probable-prime test of m->n with P = 1 and D the first of 5, -7, 9, ...
+//with (D / n) = -1
+static int bn_strong_lucas(const BnMont *m) {
+    int k = m->k;
+    long long D = 5;
+    for (int tries = 0;; ++tries) {
+        int j = bn_jacobi_small(D, m->n, k);
+        if (j == -1) break;
+        if (j == 0) return 0;
+        if (tries == 8 && bn_is_square(m->n, k)) return 0;
+        D = D > 0 ? -(D + 2) : -D + 2;
+    }
+    Limb *mem = (Limb *)calloc((size_t)(7 * k), sizeof(Limb));
+    if (!mem) {
+        fprintf(stderr, "Error: failed to allocate the Lucas test\n");
+        exit(EXIT_FAILURE);
+    }
+    Limb *d = mem, *u = d + k, *v = u + k, *qk = v + k, *dm = qk + k, *qm = dm + k, *t = qm + k;
+    //D and Q = (1 - D) / 4 mod n, then into Montgomery form
+    long long Q = (1 - D) / 4;
+    t[0] = (Limb)(D < 0 ? -D : D);
+    if (D < 0) bn_sub(t, m->n, k, t, 1);
+    bn_mont_to(m, dm, t);
+    memset(t, 0, sizeof(Limb) * (size_t)k);
+    t[0] = (Limb)(Q < 0 ? -Q : Q);
+    if (Q < 0) bn_sub(t, m->n, k, t, 1);
+    bn_mont_to(m, qm, t);
+
+    //n + 1 = d 2^s; it does not carry out since 3 divides R - 1
+    memset(t, 0, sizeof(Limb) * (size_t)k);
+    t[0] = 1;
+    bn_add_n(d, m->n, t, k);
+    long long s = bn_ctz(d, k);
+    bn_shr(d, d, k, s);
+    long long bits = bn_bit_length(d, k);
+
+    //U_j, V_j and Q^j from j = 1 along the bits of d
+    memcpy(u, m->one, sizeof(Limb) * (size_t)k);
+    memcpy(v, m->one, sizeof(Limb) * (size_t)k);
+    memcpy(qk, qm, sizeof(Limb) * (size_t)k);
+    for (long long b = bits - 2; b >= 0; --b) {
+        bn_mont_mul(m, u, u, v);
+        bn_mont_mul(m, v, v, v);
+        bn_mod_add(m, t, qk, qk);
+        bn_mod_sub(m, v, v, t);
+        bn_mont_mul(m, qk, qk, qk);
+        if (bn_bit(d, b)) {
+            bn_mont_mul(m, t, dm, u);
+            bn_mod_add(m, t, t, v);
+            bn_mod_add(m, u, u, v);
+            bn_mod_half(m, u, u);
+            bn_mod_half(m, v, t);
+            bn_mont_mul(m, qk, qk, qm);
+        }
+    }
+    int probable = bn_is_zero(u, k) || bn_is_zero(v, k);
+    for (long long r = 1; r < s && !probable; ++r) {
+        bn_mont_mul(m, v, v, v);
+        bn_mod_add(m, t, qk, qk);
+        bn_mod_sub(m, v, v, t);
+        probable = bn_is_zero(v, k);
+        bn_mont_mul(m, qk, qk, qk);
+    }
+    free(mem);
+    return probable;
+}
+
+//Baillie-PSW for n of k limbs; exact below 2^64
+int bn_is_probable_prime(const Limb *n, int k) {
+    while (k > 0 && n[k - 1] == 0) k--;
+    if (k <= 2) return is_prime_u128(k == 2 ? ((u128)n[1] << 64) | n[0] : (u128)(k ? n[0] : 0));
+    if ((n[0] & 1) == 0) return 0;
+    pthread_once(&trial_once, build_trial_groups);
+    for (int g = 0; g < ngroups; ++g) {
+        Limb r = bn_mod_1(n, k, trial_groups[g].product);
+        for (int i = 0; i < trial_groups[g].count; ++i) {
+            if (r % trial_primes[trial_groups[g].first + i] == 0) return 0;
+        }
+    }
+    BnMont m;
+    bn_mont_init(&m, n, k);
+    int probable = bn_strong_base2(&m) && bn_strong_lucas(&m);
+    bn_mont_free(&m);
+    return probable;
+}
+
+//Parses a decimal value with optional surrounding blanks into *n (freed by the caller);
+//*digits and *ndigits are set to its significant digits. Returns the limb count, or 0
+int bn_parse_decimal(const char *input, Limb **n, const char **digits, int *ndigits) {
+    static const Limb pow10[20] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+        1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+        100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+        1000000000000000000ULL, 10000000000000000000ULL
+    };
+    const char *c = input;
+    while (isspace((unsigned char)*c)) c++;
+    const char *start = c;
+    while (isdigit((unsigned char)*c)) c++;
+    int len = (int)(c - start);
+    while (isspace((unsigned char)*c)) c++;
+    if (len == 0 || *c != '\0') return 0;
+    while (len > 1 && *start == '0') {
+        start++;
+        len--;
+    }
+    //19 digits fit a limb, and each 19 digits take less than one limb of value
+    int k = len / 19 + 1;
+    Limb *v = (Limb *)calloc((size_t)k, sizeof(Limb));
+    if (!v) {
+        fprintf(stderr, "Error: failed to allocate a %d-digit number\n", len);
+        exit(EXIT_FAILURE);
+    }
+    int used = 0;
+    for (int i = 0; i < len;) {
+        int chunk = len - i < 19 ? len - i : 19;
+        Limb value = 0;
+        for (int j = 0; j < chunk; ++j) value = value * 10 + (Limb)(start[i + j] - '0');
+        i += chunk;
+        //v = v * 10^chunk + value
+        Limb carry = value;
+        for (int j = 0; j < used; ++j) {
+            u128 t = (u128)v[j] * pow10[chunk] + carry;
+            v[j] = (Limb)t;
+            carry = (Limb)(t >> 64);
+        }
+        if (carry) v[used++] = carry;
+    }
+    *n = v;
+    *digits = start;
+    *ndigits = len;
+    return k;
+}
+
+//Prints "digits: verdict" and returns whether the number is a probable prime
+static int test_number(const char *input) {
+    Limb *n;
+    const char *digits;
+    int ndigits;
+    int k = bn_parse_decimal(input, &n, &digits, &ndigits);
+    if (!k) return -1;
+    int probable = bn_is_probable_prime(n, k);
+    //below 2^64 the answer is exact
+    const char *verdict = !probable ? "not prime" : bn_bit_length(n, k) <= 64 ? "prime" : "probable prime";
+    printf("%.*s: %s\n", ndigits, digits, verdict);
+    free(n);
+    return probable;
+}
+
+static Limb splitmix64(Limb *state) {
+    Limb z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+//Modular exponentiations per second for full-size random operands by modulus size
+static void run_modexp_bench(void) {
+    static const int sizes[] = { 256, 512, 1024, 2048, 4096, 8192, 16384 };
+    Limb seed = 1;
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+        int k = sizes[s] / 64;
+        Limb *mem = (Limb *)malloc(sizeof(Limb) * (size_t)(4 * k));
+        if (!mem) {
+            fprintf(stderr, "Error: failed to allocate the benchmark operands\n");
+            exit(EXIT_FAILURE);
+        }
+        Limb *n = mem, *base = n + k, *e = base + k, *r = e + k;
+        for (int i = 0; i < k; ++i) {
+            n[i] = splitmix64(&seed);
+            base[i] = splitmix64(&seed);
+            e[i] = splitmix64(&seed);
+        }
+        n[0] |= 1;
+        n[k - 1] |= 1ULL << 63;
+        base[k - 1] >>= 1;
+        BnMont m;
+        bn_mont_init(&m, n, k);
+        bn_mont_to(&m, base, base);
+
+        struct Timer my_timer;
+        timer_start(&my_timer);
+        long long ops = 0;
+        double ms;
+        do {
+            bn_mont_pow(&m, r, base, e, k);
+            ops++;
+        } while ((ms = get_time(&my_timer)) < BN_BENCH_MS);
+        printf("[modexp] bits: %5d  limbs: %3d  window: %d  ms/op: %10.4f  ops/s: %10.1f\n", sizes[s], k,
+               bn_window_bits(64LL * k), ms / (double)ops, (double)ops * 1000.0 / ms);
+        bn_mont_free(&m);
+        free(mem);
+    }
+}
+
+//Tests opts->number_text, every line of stdin for "-", or benchmarks modexp for "bench"
+int run_bignum_test(const Options *opts, RunResult *result) {
+    if (strcmp(opts->number_text, "bench") == 0) {
+        phase_begin(PHASE_SIEVE);
+        run_modexp_bench();
+        phase_end(PHASE_SIEVE);
+        result->numbers = 1;
+        return EXIT_SUCCESS;
+    }
+
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    int rc = EXIT_SUCCESS;
+    long long tested = 0, probable = 0;
+    phase_begin(PHASE_SIEVE);
+    if (strcmp(opts->number_text, "-") != 0) {
+        int result = test_number(opts->number_text);
+        if (result < 0) {
+            fprintf(stderr, "Error: '%s' is not a non-negative integer.\n", opts->number_text);
+            rc = EXIT_FAILURE;
+        } else {
+            tested++;
+            probable += result;
+        }
+    } else {
+        //lines can run to thousands of digits
+        char *line = NULL;
+        size_t cap = 0;
+        while (getline(&line, &cap, stdin) != -1) {
+            if (line[strspn(line, " \t\r\n")] == '\0') continue;
+            int result = test_number(line);
+            if (result < 0) {
+                line[strcspn(line, "\r\n")] = '\0';
+                fprintf(stderr, "Error: '%s' is not a non-negative integer.\n", line);
+                rc = EXIT_FAILURE;
+                continue;
+            }
+            tested++;
+            probable += result;
+        }
+        free(line);
+    }
+    phase_end(PHASE_SIEVE);
+    printf("[test] tested: %lld, probable primes: %lld in %.3f ms\n", tested, probable, get_time(&my_timer));
+    result->numbers = tested;
+    return rc;
+}
@@ -0,0 +1,240 @@
+//
+//  counters.c
+//  CPrimeFinder
+//
+//  Hardware performance counters per phase (--counters). Every thread that
+//  does work opens its own perf_event_open group, and the readings are summed
+//  into the phase that was active on the main thread (see phases.c). Linux only; elsewhere
+//  the calls are no-ops and --counters prints a warning.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+static const char *counter_names[NUM_COUNTERS] = {
+    "cycles", "instructions", "L1D-miss", "LLC-miss", "branch-miss", "dTLB-miss"
+};
+
+static int counters_on = 0;
+static int counters_usable = 0;
+static Phase current_phase = PHASE_ALLOC;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static double totals[NUM_PHASES][NUM_COUNTERS];
+static int counter_seen[NUM_COUNTERS];
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+//One thread's open group; fds[i] is -1 when that event could not be opened
+typedef struct {
+    int fds[NUM_COUNTERS];
+    int slot[NUM_COUNTERS];   // position of each event in the group read
+    int nopen;
+} CounterGroup;
+
+static _Thread_local CounterGroup thread_group;
+static _Thread_local int thread_group_open = 0;
+
+static int perf_open(struct perf_event_attr *attr, int group_fd) {
+    return (int)syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+static void event_attr(struct perf_event_attr *attr, Counter c) {
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    const unsigned long long read_miss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    switch (c) {
+        case COUNTER_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case COUNTER_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case COUNTER_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+            break;
+        case COUNTER_LLC_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_LL | read_miss;
+            break;
+        case COUNTER_BRANCH_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_DTLB | read_miss;
+            break;
+    }
+}
+
+//Opens the group for the calling thread; cycles is the leader
+static int group_open(CounterGroup *g) {
+    struct perf_event_attr attr;
+    g->nopen = 0;
+    for (int i = 0; i < NUM_COUNTERS; ++i) g->fds[i] = -1;
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        event_attr(&attr, (Counter)i);
+        attr.disabled = (i == 0);
+        int fd = perf_open(&attr, i == 0 ? -1 : g->fds[0]);
+        if (fd < 0) {
+            if (i == 0) return 0;
+            continue;
+        }
+        g->fds[i] = fd;
+        g->slot[i] = g->nopen++;
+    }
+    return 1;
+}
+
+static void group_close(CounterGroup *g) {
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        if (g->fds[i] >= 0) close(g->fds[i]);
+        g->fds[i] = -1;
+    }
+}
+
+static void group_start(CounterGroup *g) {
+    ioctl(g->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+//Stops the group and adds its (multiplex-scaled) readings to phase
+static void group_stop(CounterGroup *g, Phase phase) {
+    ioctl(g->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    unsigned long long buf[3 + NUM_COUNTERS];
+    ssize_t got = read(g->fds[0], buf, sizeof(buf));
+    if (got < (ssize_t)(sizeof(unsigned long long) * 3)) return;
+    double scale = (buf[2] > 0 && buf[2] < buf[1]) ? (double)buf[1] / (double)buf[2] : 1.0;
+
+    pthread_mutex_lock(&totals_lock);
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        if (g->fds[i] < 0 || (unsigned long long)g->slot[i] >= buf[0]) continue;
+        totals[phase][i] += (double)buf[3 + g->slot[i]] * scale;
+        counter_seen[i] = 1;
+    }
+    pthread_mutex_unlock(&totals_lock);
+}
+
+void counters_init(void) {
+    counters_on = 1;
+    CounterGroup probe;
+    if (!group_open(&probe)) {
+        fprintf(stderr, "Warning: perf_event_open failed; hardware counters disabled "
+                        "(check /proc/sys/kernel/perf_event_paranoid)\n");
+        return;
+    }
+    group_close(&probe);
+    counters_usable = 1;
+}
+
+void counters_phase_begin(Phase phase) {
+    current_phase = phase;
+    if (!counters_usable) return;
+    if (!thread_group_open) {
+        if (!group_open(&thread_group)) return;
+        thread_group_open = 1;
+    }
+    group_start(&thread_group);
+}
+
+void counters_phase_end(Phase phase) {
+    if (!counters_usable || !thread_group_open) return;
+    group_stop(&thread_group, phase);
+}
+
+//Worker threads call these around their whole run; readings go to the active phase
+void counters_thread_begin(void) {
+    if (!counters_usable) return;
+    if (!group_open(&thread_group)) return;
+    thread_group_open = 1;
+    group_start(&thread_group);
+}
+
+void counters_thread_end(void) {
+    if (!counters_usable || !thread_group_open) return;
+    group_stop(&thread_group, current_phase);
+    group_close(&thread_group);
+    thread_group_open = 0;
+}
+
+#else
+
+void counters_init(void) {
+    counters_on = 1;
+    fprintf(stderr, "Warning: hardware counters need perf_event_open (Linux); --counters ignored\n");
+}
+
+void counters_phase_begin(Phase phase) {
+    current_phase = phase;
+}
+
+void counters_phase_end(Phase phase) {
+    (void)phase;
+}
+
+void counters_thread_begin(void) {
+}
+
+void counters_thread_end(void) {
+}
+
+#endif
+
+int counters_enabled(void) {
+    return counters_usable;
+}
+
+//Total of one counter in one phase, or -1 if the event never opened
+double counter_value(Phase phase, Counter c) {
+    return counter_seen[c] ? totals[phase][c] : -1.0;
+}
+
+const char *counter_name(Counter c) {
+    return counter_names[c];
+}
+
+//Prints the totals of every phase that ran, IPC and events per number
+void counters_report(long long numbers) {
+    if (!counters_on || !counters_usable) return;
+    printf("[counters] %-11s", "phase");
+    for (int c = 0; c < NUM_COUNTERS; ++c) printf(" %14s", counter_names[c]);
+    printf(" %7s\n", "IPC");
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        if (totals[p][COUNTER_CYCLES] <= 0.0) continue;
+        printf("[counters] %-11s", phase_name((Phase)p));
+        for (int c = 0; c < NUM_COUNTERS; ++c) {
+            if (counter_seen[c]) printf(" %14.0f", totals[p][c]);
+            else printf(" %14s", "n/a");
+        }
+        double cycles = totals[p][COUNTER_CYCLES];
+        if (counter_seen[COUNTER_INSTRUCTIONS] && cycles > 0) {
+            printf(" %7.3f\n", totals[p][COUNTER_INSTRUCTIONS] / cycles);
+        } else {
+            printf(" %7s\n", "n/a");
+        }
+    }
+    if (numbers < 1) return;
+    printf("[counters] per number:");
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        if (!counter_seen[c]) continue;
+        double total = 0.0;
+        for (int p = 0; p < NUM_PHASES; ++p) total += totals[p][c];
+        printf(" %s=%.4f", counter_names[c], total / (double)numbers);
+    }
+    printf("\n");
+}
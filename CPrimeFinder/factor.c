@@ -0,0 +1,242 @@
+//
+//  factor.c
+//  CPrimeFinder
+//
+//  Factorization of single numbers below 2^128 (--factor). Factors under
+//  FACTOR_TRIAL_LIMIT come off by trial division, tested by multiplying with
+//  the prime's inverse mod 2^128 instead of dividing. Whatever is left is
+//  checked for primality and otherwise split by Pollard's rho with Brent's
+//  cycle detection: the walk x -> x^2 + c runs in Montgomery form (64-bit
+//  arithmetic while the cofactor fits) and the differences are multiplied
+//  together so that one gcd covers RHO_BATCH steps. A split costs about
+//  sqrt(p) steps for the smaller factor p (n^(1/4) only when the factors are
+//  balanced): 2^16 for two 32-bit factors, milliseconds, but 2^32 for two
+//  64-bit factors, minutes.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+#define FACTOR_TRIAL_LIMIT 4096
+#define RHO_BATCH 128
+#define FACTOR_LINE 128
+
+//d divides n exactly when n * inverse <= bound (mod 2^128), and then n * inverse = n / d
+typedef struct {
+    u128 inverse;
+    u128 bound;
+    unsigned long long p;
+} TrialPrime;
+
+static TrialPrime *trial_primes;
+static long long ntrial;
+static pthread_once_t trial_once = PTHREAD_ONCE_INIT;
+
+static void build_trial_primes(void) {
+    long long n = 0;
+    long long *primes = sieve_base_primes(FACTOR_TRIAL_LIMIT, &n);
+    trial_primes = (TrialPrime *)malloc(sizeof(TrialPrime) * (size_t)n);
+    if (!trial_primes) {
+        fprintf(stderr, "Error: failed to allocate the trial division table\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long long k = 0; k < n; ++k) {
+        u128 p = (u128)primes[k];
+        u128 inv = p;
+        for (int i = 0; i < 6; ++i) inv *= 2 - p * inv;
+        trial_primes[k].inverse = inv;
+        trial_primes[k].bound = ~(u128)0 / p;
+        trial_primes[k].p = (unsigned long long)p;
+    }
+    ntrial = n;
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * n);
+}
+
+//Binary gcd; a or b may be 0
+static u128 gcd_u128(u128 a, u128 b) {
+    if (!a) return b;
+    if (!b) return a;
+    int shift = ctz_u128(a | b);
+    a >>= ctz_u128(a);
+    do {
+        b >>= ctz_u128(b);
+        if (a > b) {
+            u128 t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+static unsigned long long gcd_u64(unsigned long long a, unsigned long long b) {
+    if (!a) return b;
+    if (!b) return a;
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) {
+            unsigned long long t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+//A divisor of odd composite n from the walk x -> x^2 + c, or n when this c fails
+static unsigned long long rho64(unsigned long long n, unsigned long long c) {
+    Mont64 m;
+    mont64_init(&m, n);
+    unsigned long long cm = mont64_to(&m, c);
+    unsigned long long x = cm, y = cm, ys = cm, q = m.one, g = 1;
+    for (unsigned long long r = 1; g == 1; r <<= 1) {
+        x = y;
+        for (unsigned long long i = 0; i < r; ++i) y = mont64_add(&m, mont64_mul(&m, y, y), cm);
+        for (unsigned long long k = 0; k < r && g == 1; k += RHO_BATCH) {
+            ys = y;
+            unsigned long long steps = r - k < RHO_BATCH ? r - k : RHO_BATCH;
+            for (unsigned long long i = 0; i < steps; ++i) {
+                y = mont64_add(&m, mont64_mul(&m, y, y), cm);
+                q = mont64_mul(&m, q, x > y ? x - y : y - x);
+            }
+            g = gcd_u64(q, n);
+        }
+    }
+    //the batch overshot (or q hit 0): redo its steps one gcd at a time
+    if (g == n) {
+        do {
+            ys = mont64_add(&m, mont64_mul(&m, ys, ys), cm);
+            g = gcd_u64(x > ys ? x - ys : ys - x, n);
+        } while (g == 1);
+    }
+    return g;
+}
+
+static u128 rho128(u128 n, u128 c) {
+    Mont128 m;
+    mont128_init(&m, n);
+    u128 cm = mont128_to(&m, c);
+    u128 x = cm, y = cm, ys = cm, q = m.one, g = 1;
+    for (unsigned long long r = 1; g == 1; r <<= 1) {
+        x = y;
+        for (unsigned long long i = 0; i < r; ++i) y = mont128_add(&m, mont128_mul(&m, y, y), cm);
+        for (unsigned long long k = 0; k < r && g == 1; k += RHO_BATCH) {
+            ys = y;
+            unsigned long long steps = r - k < RHO_BATCH ? r - k : RHO_BATCH;
+            for (unsigned long long i = 0; i < steps; ++i) {
+                y = mont128_add(&m, mont128_mul(&m, y, y), cm);
+                q = mont128_mul(&m, q, x > y ? x - y : y - x);
+            }
+            g = gcd_u128(q, n);
+        }
+    }
+    if (g == n) {
+        do {
+            ys = mont128_add(&m, mont128_mul(&m, ys, ys), cm);
+            g = gcd_u128(x > ys ? x - ys : ys - x, n);
+        } while (g == 1);
+    }
+    return g;
+}
+
+//Appends the prime factors of n (no factor below FACTOR_TRIAL_LIMIT) to factors
+static void factor_rest(u128 n, u128 *factors, int *count) {
+    if (n == 1) return;
+    if (is_prime_u128(n)) {
+        factors[(*count)++] = n;
+        return;
+    }
+    u128 d = n;
+    for (unsigned long long c = 1; d == n; ++c) {
+        d = (n >> 64) ? rho128(n, c) : rho64((unsigned long long)n, c);
+    }
+    factor_rest(d, factors, count);
+    factor_rest(n / d, factors, count);
+}
+
+//Prime factors of n >= 1 in ascending order, with repeats; factors needs FACTOR_MAX slots
+int factor_u128(u128 n, u128 *factors) {
+    pthread_once(&trial_once, build_trial_primes);
+    int count = 0;
+    if (n == 0) return 0;
+    int twos = ctz_u128(n);
+    n >>= twos;
+    while (twos--) factors[count++] = 2;
+    long long k = 0;
+    for (; k < ntrial; ++k) {
+        const TrialPrime *t = &trial_primes[k];
+        if ((u128)t->p * t->p > n) break;
+        while (n * t->inverse <= t->bound) {
+            factors[count++] = t->p;
+            n *= t->inverse;
+        }
+    }
+    //past the table's reach n is 1 or prime
+    if (k < ntrial) {
+        if (n > 1) factors[count++] = n;
+        return count;
+    }
+    int first = count;
+    factor_rest(n, factors, &count);
+    //rho finds the large factors in no particular order
+    for (int i = first + 1; i < count; ++i) {
+        u128 f = factors[i];
+        int j = i;
+        while (j > first && factors[j - 1] > f) {
+            factors[j] = factors[j - 1];
+            j--;
+        }
+        factors[j] = f;
+    }
+    return count;
+}
+
+//Prints "n: p p p" the way coreutils factor does
+static void print_factorization(u128 n) {
+    u128 factors[FACTOR_MAX];
+    char digits[U128_DIGITS + 1];
+    int count = factor_u128(n, factors);
+    printf("%s:", u128_format(n, digits));
+    for (int i = 0; i < count; ++i) printf(" %s", u128_format(factors[i], digits));
+    printf("\n");
+}
+
+//Factors opts->number, or every number on stdin
+int run_factor(const Options *opts, RunResult *result) {
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    int rc = EXIT_SUCCESS;
+    long long factored = 0;
+    phase_begin(PHASE_SIEVE);
+    if (!opts->number_stdin) {
+        print_factorization(opts->number);
+        factored++;
+    } else {
+        char line[FACTOR_LINE];
+        while (fgets(line, sizeof(line), stdin)) {
+            u128 n;
+            if (line[strspn(line, " \t\r\n")] == '\0') continue;
+            if (!parse_u128(line, &n) || n == 0) {
+                line[strcspn(line, "\r\n")] = '\0';
+                fprintf(stderr, "Error: '%s' is not an integer in [1, 2^128).\n", line);
+                rc = EXIT_FAILURE;
+                continue;
+            }
+            print_factorization(n);
+            factored++;
+        }
+    }
+    phase_end(PHASE_SIEVE);
+    printf("[factor] factored: %lld in %.3f ms\n", factored, get_time(&my_timer));
+    result->numbers = factored;
+    return rc;
+}
@@ -0,0 +1,186 @@
+//
+//  gaps.c
+//  CPrimeFinder
+//
+//  Prime gap statistics (--gaps). Each segment is sieved into a per-thread
+//  buffer and scanned once: every gap whose lower prime falls in the segment
+//  goes into the thread's histogram along with its first occurrence. The gap
+//  that leaves a segment is closed by sieving a short window past its end, so
+//  segments never need each other and memory stays bounded at any max_value.
+//  Threads are merged by summing counts and taking the smallest first
+//  occurrence; maximal gaps follow from the first occurrences.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+//every gap between primes below 2^64 is under 1552
+#define MAX_GAP 2048
+#define GAP_WINDOW 2048
+
+typedef struct {
+    long long count[MAX_GAP];
+    long long first[MAX_GAP];     // smallest lower prime with this gap, -1 if unseen
+    long long primes;
+    unsigned char *seg;           // segment buffer
+    unsigned char *window;        // look-ahead past the segment end, GAP_WINDOW bytes
+} GapWorker;
+
+typedef struct {
+    long long max_value;
+    const PreSieve *presieve;
+    const long long *primes;
+    long long nprimes;
+    GapWorker *workers;
+} GapContext;
+
+static void record_gap(GapWorker *w, long long p, long long gap) {
+    if (gap >= MAX_GAP) {
+        fprintf(stderr, "Error: gap of %lld after %lld exceeds the histogram\n", gap, p);
+        exit(EXIT_FAILURE);
+    }
+    w->count[gap]++;
+    if (w->first[gap] < 0 || p < w->first[gap]) w->first[gap] = p;
+}
+
+//Sieves [lo, lo + len) into buf
+static void sieve_window(const GapContext *ctx, unsigned char *buf, long long lo, long long len) {
+    presieve_fill(ctx->presieve, buf, lo, len);
+    cross_off_segment(buf, lo, len, ctx->primes, ctx->nprimes);
+}
+
+//Smallest prime in [from, max_value], or -1; sieves GAP_WINDOW numbers at a time
+static long long next_prime_after(const GapContext *ctx, GapWorker *w, long long from) {
+    while (from <= ctx->max_value) {
+        long long len = ctx->max_value + 1 - from;
+        if (len > GAP_WINDOW) len = GAP_WINDOW;
+        sieve_window(ctx, w->window, from, len);
+        long long at = simd_next_nonzero(w->window, 0, len);
+        if (at < len) return from + at;
+        from += len;
+    }
+    return -1;
+}
+
+static void gap_segment_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    (void)index;
+    GapContext *ctx = (GapContext *)arg;
+    GapWorker *w = &ctx->workers[thread_id];
+    long long len = hi - lo;
+    sieve_window(ctx, w->seg, lo, len);
+
+    long long prev = -1;
+    for (long long at = simd_next_nonzero(w->seg, 0, len); at < len; at = simd_next_nonzero(w->seg, at + 1, len)) {
+        long long p = lo + at;
+        if (prev >= 0) record_gap(w, prev, p - prev);
+        prev = p;
+        w->primes++;
+    }
+    if (prev >= 0) {
+        long long next = next_prime_after(ctx, w, hi);
+        if (next >= 0) record_gap(w, prev, next - prev);
+    }
+}
+
+//Sieves [0, max_value] segment by segment and prints the gap statistics
+int run_gaps(const Options *opts, RunResult *result) {
+    (void)result;
+    struct Timer my_timer;
+    timer_start(&my_timer);
+
+    phase_begin(PHASE_BASE_SIEVE);
+    PreSieve presieve;
+    presieve_init(&presieve, opts->presieve_depth);
+    long long nprimes = 0;
+    long long *primes = sieve_base_primes(isqrt_ll(opts->max_value), &nprimes);
+    long long skip = 0;
+    while (skip < nprimes && primes[skip] <= presieve.largest) skip++;
+    phase_end(PHASE_BASE_SIEVE);
+
+    int nthreads = (int)opts->thread_count;
+    GapWorker *workers = (GapWorker *)calloc((size_t)nthreads, sizeof(GapWorker));
+    if (!workers) {
+        fprintf(stderr, "Error: failed to allocate gap workers\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < nthreads; ++t) {
+        workers[t].seg = (unsigned char *)malloc((size_t)opts->segment_size);
+        workers[t].window = (unsigned char *)malloc(GAP_WINDOW);
+        if (!workers[t].seg || !workers[t].window) {
+            fprintf(stderr, "Error: failed to allocate gap segment buffers\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int g = 0; g < MAX_GAP; ++g) workers[t].first[g] = -1;
+    }
+    long long buffer_bytes = (long long)nthreads * (opts->segment_size + GAP_WINDOW);
+    mem_track(MEM_SEGMENTS, buffer_bytes);
+    mem_track(MEM_THREADS, (long long)sizeof(GapWorker) * nthreads);
+
+    GapContext ctx;
+    ctx.max_value = opts->max_value;
+    ctx.presieve = &presieve;
+    ctx.primes = primes + skip;
+    ctx.nprimes = nprimes - skip;
+    ctx.workers = workers;
+
+    phase_begin(PHASE_SIEVE);
+    for_each_segment(0, opts->max_value + 1, opts->segment_size, nthreads, gap_segment_fn, &ctx);
+    phase_end(PHASE_SIEVE);
+
+    //merge into worker 0: counts add, first occurrences take the minimum
+    GapWorker *all = &workers[0];
+    for (int t = 1; t < nthreads; ++t) {
+        all->primes += workers[t].primes;
+        for (int g = 0; g < MAX_GAP; ++g) {
+            all->count[g] += workers[t].count[g];
+            long long f = workers[t].first[g];
+            if (f >= 0 && (all->first[g] < 0 || f < all->first[g])) all->first[g] = f;
+        }
+    }
+    double ms = get_time(&my_timer);
+
+    long long ngaps = 0;
+    int largest = 0;
+    for (int g = 0; g < MAX_GAP; ++g) {
+        ngaps += all->count[g];
+        if (all->count[g]) largest = g;
+    }
+    printf("[gaps] total primes: %lld\n", all->primes);
+    printf("[gaps] gaps: %lld\n", ngaps);
+    if (ngaps) printf("[gaps] largest gap: %d after %lld\n", largest, all->first[largest]);
+    for (int g = 0; g < MAX_GAP; ++g) {
+        if (all->count[g]) printf("[gaps] gap %4d: %14lld  first after %lld\n", g, all->count[g], all->first[g]);
+    }
+    //a gap is maximal when no larger gap occurs before its first occurrence
+    int maximal[MAX_GAP];
+    int nmaximal = 0;
+    long long earliest_larger = -1;
+    for (int g = largest; g > 0; --g) {
+        long long f = all->first[g];
+        if (f < 0) continue;
+        if (earliest_larger < 0 || f < earliest_larger) {
+            maximal[nmaximal++] = g;
+            earliest_larger = f;
+        }
+    }
+    printf("[gaps] maximal gaps:");
+    for (int i = nmaximal - 1; i >= 0; --i) printf(" %d@%lld", maximal[i], all->first[maximal[i]]);
+    printf("\n");
+    printf("[gaps] elapsed: %.3f ms\n", ms);
+
+    for (int t = 0; t < nthreads; ++t) {
+        free(workers[t].seg);
+        free(workers[t].window);
+    }
+    mem_track(MEM_SEGMENTS, -buffer_bytes);
+    mem_track(MEM_THREADS, -(long long)sizeof(GapWorker) * nthreads);
+    free(workers);
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+    presieve_free(&presieve);
+
+    return EXIT_SUCCESS;
+}
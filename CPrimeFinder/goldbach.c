@@ -0,0 +1,174 @@
+//
+//  goldbach.c
+//  CPrimeFinder
+//
+//  Goldbach verification (--goldbach): for every even n in [4, max_value],
+//  find the smallest prime p with n - p prime. Each segment of n values is
+//  checked against a sieved window that reaches GOLDBACH_WINDOW below the
+//  segment, so n - p is a byte lookup for every p in the resident table of
+//  small primes that fits the window. Larger p (none are needed below 4e18)
+//  fall back to is_prime. Each thread keeps the cases with the largest p.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+#define GOLDBACH_WINDOW 8192
+#define GOLDBACH_HARDEST 10
+
+typedef struct {
+    long long n;
+    long long p;
+} GoldbachCase;
+
+typedef struct {
+    unsigned char *window;    // primality of [lo - GOLDBACH_WINDOW, hi)
+    long long checked;
+    GoldbachCase hardest[GOLDBACH_HARDEST];   // largest p first
+    int nhardest;
+    long long counterexample; // first even n without a decomposition, or 0
+} GoldbachWorker;
+
+typedef struct {
+    const PreSieve *presieve;
+    const long long *primes;  // odd base primes past the pre-sieve pattern
+    long long nprimes;
+    const long long *table;   // odd primes below GOLDBACH_WINDOW
+    long long ntable;
+    GoldbachWorker *workers;
+} GoldbachContext;
+
+//Keeps c if it is among the GOLDBACH_HARDEST largest p seen (smaller n wins ties)
+static void keep_hardest(GoldbachWorker *w, GoldbachCase c) {
+    int at = w->nhardest;
+    while (at > 0 && (w->hardest[at - 1].p < c.p || (w->hardest[at - 1].p == c.p && w->hardest[at - 1].n > c.n))) at--;
+    if (at == GOLDBACH_HARDEST) return;
+    int last = w->nhardest < GOLDBACH_HARDEST ? w->nhardest : GOLDBACH_HARDEST - 1;
+    memmove(&w->hardest[at + 1], &w->hardest[at], sizeof(GoldbachCase) * (size_t)(last - at));
+    w->hardest[at] = c;
+    if (w->nhardest < GOLDBACH_HARDEST) w->nhardest++;
+}
+
+//Smallest p past the table, testing both sides directly; 0 if there is none
+static long long slow_smallest_p(long long n, long long from) {
+    for (long long p = from | 1; p <= n / 2; p += 2) {
+        if (is_prime(p) && is_prime(n - p)) return p;
+    }
+    return 0;
+}
+
+static void goldbach_segment_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    (void)index;
+    GoldbachContext *ctx = (GoldbachContext *)arg;
+    GoldbachWorker *w = &ctx->workers[thread_id];
+    long long wlo = lo > GOLDBACH_WINDOW ? lo - GOLDBACH_WINDOW : 0;
+    presieve_fill(ctx->presieve, w->window, wlo, hi - wlo);
+    cross_off_segment(w->window, wlo, hi - wlo, ctx->primes, ctx->nprimes);
+    const unsigned char *is_prime_at = w->window - wlo;
+
+    for (long long n = lo + (lo & 1LL); n < hi; n += 2) {
+        long long p = 0;
+        if (n == 4) {
+            p = 2;
+        } else {
+            long long k = 0;
+            for (; k < ctx->ntable && ctx->table[k] <= n / 2; ++k) {
+                if (is_prime_at[n - ctx->table[k]]) {
+                    p = ctx->table[k];
+                    break;
+                }
+            }
+            if (!p && k == ctx->ntable) p = slow_smallest_p(n, GOLDBACH_WINDOW + 1);
+        }
+        if (!p) {
+            if (!w->counterexample || n < w->counterexample) w->counterexample = n;
+            continue;
+        }
+        w->checked++;
+        if (w->nhardest < GOLDBACH_HARDEST || p >= w->hardest[GOLDBACH_HARDEST - 1].p) {
+            GoldbachCase c = { n, p };
+            keep_hardest(w, c);
+        }
+    }
+}
+
+//Checks every even n in [4, max_value] and reports the cases needing the largest p
+int run_goldbach(const Options *opts, RunResult *result) {
+    (void)result;
+    struct Timer my_timer;
+    timer_start(&my_timer);
+
+    phase_begin(PHASE_BASE_SIEVE);
+    PreSieve presieve;
+    presieve_init(&presieve, opts->presieve_depth);
+    long long nprimes = 0;
+    long long *primes = sieve_base_primes(isqrt_ll(opts->max_value), &nprimes);
+    long long skip = 0;
+    while (skip < nprimes && primes[skip] <= presieve.largest) skip++;
+    long long ntable = 0;
+    long long *table = sieve_base_primes(GOLDBACH_WINDOW, &ntable);
+    phase_end(PHASE_BASE_SIEVE);
+
+    int nthreads = (int)opts->thread_count;
+    GoldbachWorker *workers = (GoldbachWorker *)calloc((size_t)nthreads, sizeof(GoldbachWorker));
+    if (!workers) {
+        fprintf(stderr, "Error: failed to allocate Goldbach workers\n");
+        exit(EXIT_FAILURE);
+    }
+    long long window_bytes = opts->segment_size + GOLDBACH_WINDOW;
+    for (int t = 0; t < nthreads; ++t) {
+        workers[t].window = (unsigned char *)malloc((size_t)window_bytes);
+        if (!workers[t].window) {
+            fprintf(stderr, "Error: failed to allocate Goldbach windows\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    mem_track(MEM_SEGMENTS, window_bytes * nthreads);
+
+    GoldbachContext ctx;
+    ctx.presieve = &presieve;
+    ctx.primes = primes + skip;
+    ctx.nprimes = nprimes - skip;
+    ctx.table = table;
+    ctx.ntable = ntable;
+    ctx.workers = workers;
+
+    phase_begin(PHASE_SIEVE);
+    if (opts->max_value >= 4) {
+        for_each_segment(4, opts->max_value + 1, opts->segment_size, nthreads, goldbach_segment_fn, &ctx);
+    }
+    phase_end(PHASE_SIEVE);
+
+    //merge into worker 0
+    GoldbachWorker *all = &workers[0];
+    for (int t = 1; t < nthreads; ++t) {
+        all->checked += workers[t].checked;
+        for (int i = 0; i < workers[t].nhardest; ++i) keep_hardest(all, workers[t].hardest[i]);
+        long long c = workers[t].counterexample;
+        if (c && (!all->counterexample || c < all->counterexample)) all->counterexample = c;
+    }
+    double ms = get_time(&my_timer);
+
+    printf("[goldbach] verified even numbers: %lld\n", all->checked);
+    if (all->counterexample) printf("[goldbach] COUNTEREXAMPLE: %lld\n", all->counterexample);
+    for (int i = 0; i < all->nhardest; ++i) {
+        printf("[goldbach] hardest %2d: %lld = %lld + %lld\n", i + 1, all->hardest[i].n, all->hardest[i].p,
+               all->hardest[i].n - all->hardest[i].p);
+    }
+    printf("[goldbach] elapsed: %.3f ms\n", ms);
+    int rc = all->counterexample ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    for (int t = 0; t < nthreads; ++t) free(workers[t].window);
+    mem_track(MEM_SEGMENTS, -window_bytes * nthreads);
+    free(workers);
+    free(table);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * ntable);
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+    presieve_free(&presieve);
+
+    return rc;
+}
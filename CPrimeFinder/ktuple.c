@@ -0,0 +1,256 @@
+//
+//  ktuple.c
+//  CPrimeFinder
+//
+//  Prime k-tuple mode (--tuples=twin|triplet|quadruplet). Instead of sieving
+//  numbers and scanning for neighbours, each segment sieves tuple starts: a
+//  start n survives only while every member n + offset is free of small
+//  factors. The pre-sieve pattern becomes a pattern of admissible starts, each
+//  base prime crosses off one residue class per offset, and whatever is left
+//  is a tuple. Segments run in parallel on per-thread buffers, so memory stays
+//  at a few segments regardless of max_value.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+#define MAX_TUPLE_PATTERNS 2
+#define MAX_TUPLE_SIZE 4
+//starts below this are checked directly, so the wheel never meets its own primes
+#define TUPLE_SIEVE_START 32
+
+typedef struct {
+    int k;
+    int offsets[MAX_TUPLE_SIZE];
+} TuplePattern;
+
+typedef struct {
+    const char *name;
+    int npatterns;
+    TuplePattern patterns[MAX_TUPLE_PATTERNS];
+} TupleKindInfo;
+
+static const TupleKindInfo tuple_kinds[] = {
+    { "none", 0, { { 0, { 0 } } } },
+    { "twin", 1, { { 2, { 0, 2 } } } },
+    { "triplet", 2, { { 3, { 0, 2, 6 } }, { 3, { 0, 4, 6 } } } },
+    { "quadruplet", 1, { { 4, { 0, 2, 6, 8 } } } },
+};
+
+const char *tuple_kind_name(TupleKind kind) {
+    return tuple_kinds[kind].name;
+}
+
+//Looks up a --tuples value; returns 0 for an unknown name
+int parse_tuple_kind(const char *name, TupleKind *out) {
+    for (int i = TUPLES_TWIN; i < (int)(sizeof(tuple_kinds) / sizeof(tuple_kinds[0])); ++i) {
+        if (strcmp(name, tuple_kinds[i].name) == 0) {
+            *out = (TupleKind)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Per-thread tuple count on its own cache line
+typedef struct {
+    long long count;
+    char pad[64 - sizeof(long long)];
+} TupleCount;
+
+typedef struct {
+    const TupleKindInfo *kind;
+    long long period;
+    unsigned char *admissible[MAX_TUPLE_PATTERNS];  // wheel pattern of starts, one period long
+    const long long *primes;                        // odd base primes past the wheel
+    long long nprimes;
+    long long segment_size;
+    unsigned char **buffers;                        // [thread][pattern] segment buffers
+    TupleCount *counts;
+    int list;
+    OrderedOutput output;                           // --list text, printed in segment order
+} TupleContext;
+
+static int tuple_at(const TuplePattern *pattern, long long n) {
+    for (int i = 0; i < pattern->k; ++i) {
+        if (!is_prime(n + pattern->offsets[i])) return 0;
+    }
+    return 1;
+}
+
+//Appends " (n n+a n+b ...)" to the growing text buffer
+static void append_tuple(TextBuf *out, const TuplePattern *pattern, long long n) {
+    text_reserve(out, (size_t)pattern->k * 21 + 4);
+    out->text[out->len++] = ' ';
+    out->text[out->len++] = '(';
+    for (int i = 0; i < pattern->k; ++i) {
+        if (i) out->text[out->len++] = ' ';
+        out->len += (size_t)sprintf(out->text + out->len, "%lld", n + pattern->offsets[i]);
+    }
+    out->text[out->len++] = ')';
+}
+
+//Crosses off starts in [lo, lo + len) that put a multiple of a base prime (from p*p on) at some offset
+static void cross_off_starts(unsigned char *seg, long long lo, long long len, const TuplePattern *pattern,
+                             const long long *primes, long long nprimes) {
+    long long hi = lo + len;
+    for (long long k = 0; k < nprimes; ++k) {
+        long long p = primes[k];
+        if (p * p >= hi + pattern->offsets[pattern->k - 1]) break;
+        for (int i = 0; i < pattern->k; ++i) {
+            long long o = pattern->offsets[i];
+            //odd multiples m of p with m = n + o for a start n in [lo, hi)
+            long long m = ((lo + o + p - 1) / p) * p;
+            if (m < p * p) m = p * p;
+            if ((m & 1LL) == 0) m += p;
+            for (; m - o < hi; m += 2 * p) seg[m - o - lo] = 0;
+        }
+    }
+}
+
+//Sieves the starts of one segment for every pattern, then counts or lists them
+static void tuple_segment_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    TupleContext *ctx = (TupleContext *)arg;
+    const TupleKindInfo *kind = ctx->kind;
+    unsigned char **bufs = ctx->buffers + (size_t)thread_id * MAX_TUPLE_PATTERNS;
+    long long len = hi - lo;
+    for (int p = 0; p < kind->npatterns; ++p) {
+        pattern_fill(ctx->admissible[p], ctx->period, bufs[p], lo, len);
+        cross_off_starts(bufs[p], lo, len, &kind->patterns[p], ctx->primes, ctx->nprimes);
+    }
+
+    if (!ctx->list) {
+        for (int p = 0; p < kind->npatterns; ++p) {
+            ctx->counts[thread_id].count += simd_count_nonzero(bufs[p], len);
+        }
+        return;
+    }
+
+    //merge the patterns' survivors in start order
+    TextBuf *out = text_new();
+    long long pos[MAX_TUPLE_PATTERNS];
+    for (int p = 0; p < kind->npatterns; ++p) pos[p] = simd_next_nonzero(bufs[p], 0, len);
+    for (;;) {
+        int best = 0;
+        for (int p = 1; p < kind->npatterns; ++p) {
+            if (pos[p] < pos[best]) best = p;
+        }
+        if (pos[best] >= len) break;
+        append_tuple(out, &kind->patterns[best], lo + pos[best]);
+        ctx->counts[thread_id].count++;
+        pos[best] = simd_next_nonzero(bufs[best], pos[best] + 1, len);
+    }
+    ordered_put(&ctx->output, index, out);
+}
+
+//Counts (and with --list prints) the prime k-tuples whose members are all <= max_value
+int run_tuples(const Options *opts, RunResult *result) {
+    (void)result;
+    const TupleKindInfo *kind = &tuple_kinds[opts->tuples];
+    const char *label = kind->name;
+    int max_offset = 0;
+    for (int p = 0; p < kind->npatterns; ++p) {
+        int last = kind->patterns[p].offsets[kind->patterns[p].k - 1];
+        if (last > max_offset) max_offset = last;
+    }
+    long long last_start = opts->max_value - max_offset;
+
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    if (opts->list) printf("[%s] list:", label);
+
+    //starts below TUPLE_SIEVE_START directly, in order
+    long long total = 0;
+    TextBuf head = { NULL, 0, 0 };
+    for (long long n = 0; n <= last_start && n < TUPLE_SIEVE_START; ++n) {
+        for (int p = 0; p < kind->npatterns; ++p) {
+            const TuplePattern *pattern = &kind->patterns[p];
+            if (n + pattern->offsets[pattern->k - 1] > opts->max_value || !tuple_at(pattern, n)) continue;
+            total++;
+            if (opts->list) append_tuple(&head, pattern, n);
+        }
+    }
+    if (head.len) fwrite(head.text, 1, head.len, stdout);
+    free(head.text);
+
+    if (last_start >= TUPLE_SIEVE_START) {
+        phase_begin(PHASE_BASE_SIEVE);
+        PreSieve presieve;
+        presieve_init(&presieve, opts->presieve_depth);
+        long long nprimes = 0;
+        long long *primes = sieve_base_primes(isqrt_ll(opts->max_value), &nprimes);
+        long long skip = 0;
+        while (skip < nprimes && primes[skip] <= presieve.largest) skip++;
+
+        TupleContext ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.kind = kind;
+        ctx.period = presieve.period;
+        ctx.primes = primes + skip;
+        ctx.nprimes = nprimes - skip;
+        ctx.segment_size = opts->segment_size;
+        ctx.list = opts->list;
+        //a start is admissible when every member is coprime to the wheel primes
+        for (int p = 0; p < kind->npatterns; ++p) {
+            const TuplePattern *pattern = &kind->patterns[p];
+            ctx.admissible[p] = (unsigned char *)malloc((size_t)presieve.period);
+            if (!ctx.admissible[p]) {
+                fprintf(stderr, "Error: failed to allocate tuple pattern\n");
+                exit(EXIT_FAILURE);
+            }
+            for (long long r = 0; r < presieve.period; ++r) {
+                unsigned char ok = 1;
+                for (int i = 0; i < pattern->k; ++i) ok &= presieve.pattern[(r + pattern->offsets[i]) % presieve.period];
+                ctx.admissible[p][r] = ok;
+            }
+        }
+        phase_end(PHASE_BASE_SIEVE);
+
+        int nthreads = (int)opts->thread_count;
+        long long buffer_bytes = (long long)nthreads * kind->npatterns * opts->segment_size;
+        ctx.buffers = (unsigned char **)calloc((size_t)nthreads * MAX_TUPLE_PATTERNS, sizeof(unsigned char *));
+        ctx.counts = (TupleCount *)calloc((size_t)nthreads, sizeof(TupleCount));
+        if (!ctx.buffers || !ctx.counts) {
+            fprintf(stderr, "Error: failed to allocate tuple workers\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int t = 0; t < nthreads; ++t) {
+            for (int p = 0; p < kind->npatterns; ++p) {
+                unsigned char *buf = (unsigned char *)malloc((size_t)opts->segment_size);
+                if (!buf) {
+                    fprintf(stderr, "Error: failed to allocate tuple segment buffers\n");
+                    exit(EXIT_FAILURE);
+                }
+                ctx.buffers[t * MAX_TUPLE_PATTERNS + p] = buf;
+            }
+        }
+        mem_track(MEM_SEGMENTS, buffer_bytes + presieve.period * kind->npatterns);
+        if (ctx.list) ordered_init(&ctx.output, nthreads, ordered_write_text, NULL);
+
+        phase_begin(PHASE_SIEVE);
+        for_each_segment(TUPLE_SIEVE_START, last_start + 1, opts->segment_size, nthreads, tuple_segment_fn, &ctx);
+        phase_end(PHASE_SIEVE);
+
+        for (int t = 0; t < nthreads; ++t) {
+            total += ctx.counts[t].count;
+            for (int p = 0; p < kind->npatterns; ++p) free(ctx.buffers[t * MAX_TUPLE_PATTERNS + p]);
+        }
+        for (int p = 0; p < kind->npatterns; ++p) free(ctx.admissible[p]);
+        mem_track(MEM_SEGMENTS, -(buffer_bytes + presieve.period * kind->npatterns));
+        if (ctx.list) ordered_free(&ctx.output);
+        free(ctx.counts);
+        free(ctx.buffers);
+        free(primes);
+        mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+        presieve_free(&presieve);
+    }
+    double ms = get_time(&my_timer);
+
+    if (opts->list) printf("\n");
+    printf("[%s] total tuples: %lld\n", label, total);
+    printf("[%s] elapsed: %.3f ms\n", label, ms);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+//
+//  memory.c
+//  CPrimeFinder
+//
+//  Memory accounting (--memory): bytes allocated per subsystem with their
+//  high-water marks, peak resident set size and page-fault counts. Call sites
+//  keep using malloc/free and report sizes with mem_track.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+
+#include "pprimes.h"
+
+static const char *mem_names[NUM_MEM_KINDS] = {
+    "results", "base-primes", "segments", "output", "threads"
+};
+
+static atomic_llong mem_current[NUM_MEM_KINDS];
+static atomic_llong mem_peak[NUM_MEM_KINDS];
+static atomic_llong total_current;
+static atomic_llong total_peak;
+
+const char *mem_name(MemKind kind) {
+    return mem_names[kind];
+}
+
+static void raise_peak(atomic_llong *peak, long long value) {
+    long long seen = atomic_load(peak);
+    while (value > seen && !atomic_compare_exchange_weak(peak, &seen, value)) {
+    }
+}
+
+//Records an allocation (bytes > 0) or a release (bytes < 0) for kind
+void mem_track(MemKind kind, long long bytes) {
+    long long now = atomic_fetch_add(&mem_current[kind], bytes) + bytes;
+    raise_peak(&mem_peak[kind], now);
+    long long total = atomic_fetch_add(&total_current, bytes) + bytes;
+    raise_peak(&total_peak, total);
+}
+
+//High-water mark of kind's live bytes
+long long mem_peak_bytes(MemKind kind) {
+    return atomic_load(&mem_peak[kind]);
+}
+
+//High-water mark of all tracked bytes live at the same time
+long long mem_total_peak_bytes(void) {
+    return atomic_load(&total_peak);
+}
+
+//Peak resident set size in bytes (ru_maxrss is KiB on Linux, bytes on macOS).
+//On Linux ru_maxrss survives exec and can report the parent's peak, so VmHWM is preferred.
+long long peak_rss_bytes(void) {
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long long kib = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmHWM: %lld kB", &kib) == 1) break;
+        }
+        fclose(f);
+        if (kib >= 0) return kib * 1024LL;
+    }
+#endif
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#ifdef __APPLE__
+    return (long long)usage.ru_maxrss;
+#else
+    return (long long)usage.ru_maxrss * 1024LL;
+#endif
+}
+
+//Minor (no I/O) and major page faults of this process so far
+void page_faults(long long *minor, long long *major) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        *minor = *major = -1;
+        return;
+    }
+    *minor = (long long)usage.ru_minflt;
+    *major = (long long)usage.ru_majflt;
+}
+
+void memory_report(void) {
+    long long minor, major;
+    page_faults(&minor, &major);
+    printf("[memory] peak rss: %lld bytes (%.1f MiB)\n", peak_rss_bytes(), (double)peak_rss_bytes() / 1048576.0);
+    for (int k = 0; k < NUM_MEM_KINDS; ++k) {
+        printf("[memory] %-11s peak %14lld bytes\n", mem_names[k], mem_peak_bytes((MemKind)k));
+    }
+    printf("[memory] %-11s peak %14lld bytes\n", "tracked", mem_total_peak_bytes());
+    printf("[memory] page faults: %lld minor, %lld major\n", minor, major);
+}
@@ -0,0 +1,166 @@
+//
+//  nextprime.c
+//  CPrimeFinder
+//
+//  Nearest prime above or below a number (--next, --prev). Below
+//  NEXT_SIEVE_LIMIT a window of NEXT_WINDOW numbers next to X is sieved with
+//  the base primes up to its square root, doubling the window until it holds
+//  a prime. Past it, finding each base prime's first multiple in the window
+//  costs more than testing the dozen or so candidates before the next prime,
+//  so the numbers coprime to 30 are tested one by one with is_prime_u128,
+//  which is exact below 2^64 and Baillie-PSW above. Either way the answer
+//  takes microseconds rather than a sieve from 2.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+#define NEXT_WINDOW 1024
+#define NEXT_SIEVE_LIMIT (1LL << 16)
+#define NEXT_LINE 128
+
+//steps from each residue mod 30 to the next one coprime to 30
+static const unsigned char wheel_next[30] = {
+    1, 6, 5, 4, 3, 2, 1, 4, 3, 2, 1, 2, 1, 4, 3, 2, 1, 2, 1, 4, 3, 2, 1, 6, 5, 4, 3, 2, 1, 2
+};
+//steps from each residue mod 30 to the previous one coprime to 30
+static const unsigned char wheel_prev[30] = {
+    1, 2, 1, 2, 3, 4, 5, 6, 1, 2, 3, 4, 1, 2, 1, 2, 3, 4, 1, 2, 1, 2, 3, 4, 1, 2, 3, 4, 5, 6
+};
+
+//Base primes past the pre-sieve pattern, grown as larger windows need them
+typedef struct {
+    PreSieve presieve;
+    long long *primes;
+    long long nprimes;
+    long long skip;
+    long long limit;
+    unsigned char *window;
+    long long window_size;
+} NextContext;
+
+static void ensure_base_primes(NextContext *ctx, long long limit) {
+    if (limit <= ctx->limit) return;
+    free(ctx->primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * ctx->nprimes);
+    ctx->primes = sieve_base_primes(limit, &ctx->nprimes);
+    ctx->limit = limit;
+    ctx->skip = 0;
+    while (ctx->skip < ctx->nprimes && ctx->primes[ctx->skip] <= ctx->presieve.largest) ctx->skip++;
+}
+
+//Sieves [lo, lo + len) into ctx->window
+static void sieve_window(NextContext *ctx, long long lo, long long len) {
+    if (len > ctx->window_size) {
+        free(ctx->window);
+        mem_track(MEM_SEGMENTS, -ctx->window_size);
+        ctx->window = (unsigned char *)malloc((size_t)len);
+        if (!ctx->window) {
+            fprintf(stderr, "Error: failed to allocate a %lld-number window\n", len);
+            exit(EXIT_FAILURE);
+        }
+        ctx->window_size = len;
+        mem_track(MEM_SEGMENTS, len);
+    }
+    ensure_base_primes(ctx, isqrt_ll(lo + len - 1));
+    presieve_fill(&ctx->presieve, ctx->window, lo, len);
+    cross_off_segment(ctx->window, lo, len, ctx->primes + ctx->skip, ctx->nprimes - ctx->skip);
+}
+
+//Smallest prime above x; returns 0 if there is none below 2^128
+static u128 next_prime(NextContext *ctx, u128 x) {
+    if (x < 2) return 2;
+    if (x < NEXT_SIEVE_LIMIT - NEXT_WINDOW) {
+        long long lo = (long long)x + 1;
+        for (long long len = NEXT_WINDOW;; len *= 2) {
+            sieve_window(ctx, lo, len);
+            for (long long i = 0; i < len; ++i) {
+                if (ctx->window[i]) return (u128)(lo + i);
+            }
+            lo += len;
+        }
+    }
+    u128 n = x + 1;
+    if (n < x) return 0;
+    for (int r = (int)(n % 30);; r = (r + wheel_next[r]) % 30) {
+        if (r % 2 && r % 3 && r % 5 && is_prime_u128(n)) return n;
+        u128 m = n + wheel_next[r];
+        if (m < n) return 0;
+        n = m;
+    }
+}
+
+//Largest prime below x, or 0 if x <= 2
+static u128 prev_prime(NextContext *ctx, u128 x) {
+    if (x <= 2) return 0;
+    if (x <= 7) return x <= 3 ? 2 : x <= 5 ? 3 : 5;
+    if (x < NEXT_SIEVE_LIMIT) {
+        long long hi = (long long)x;
+        for (long long len = NEXT_WINDOW;; len *= 2) {
+            long long lo = hi - len < 0 ? 0 : hi - len;
+            sieve_window(ctx, lo, hi - lo);
+            for (long long i = hi - lo - 1; i >= 0; --i) {
+                if (ctx->window[i]) return (u128)(lo + i);
+            }
+            hi = lo;
+        }
+    }
+    u128 n = x - 1;
+    for (int r = (int)(n % 30);; r = (r + 30 - wheel_prev[r]) % 30) {
+        if (r % 2 && r % 3 && r % 5 && is_prime_u128(n)) return n;
+        n -= wheel_prev[r];
+    }
+}
+
+//Prints "x: p", or "x: none" when there is no such prime
+static void print_neighbour(NextContext *ctx, u128 x, int next) {
+    char digits[U128_DIGITS + 1];
+    u128 p = next ? next_prime(ctx, x) : prev_prime(ctx, x);
+    printf("%s: ", u128_format(x, digits));
+    printf("%s\n", p ? u128_format(p, digits) : "none");
+}
+
+//Answers --next or --prev for opts->number, or for every number on stdin
+int run_next_prime(const Options *opts, RunResult *result) {
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    const char *label = opts->next_prime ? "next" : "prev";
+    NextContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    presieve_init(&ctx.presieve, opts->presieve_depth);
+
+    int rc = EXIT_SUCCESS;
+    long long queries = 0;
+    phase_begin(PHASE_SIEVE);
+    if (!opts->number_stdin) {
+        print_neighbour(&ctx, opts->number, opts->next_prime);
+        queries++;
+    } else {
+        char line[NEXT_LINE];
+        while (fgets(line, sizeof(line), stdin)) {
+            u128 x;
+            if (line[strspn(line, " \t\r\n")] == '\0') continue;
+            if (!parse_u128(line, &x)) {
+                line[strcspn(line, "\r\n")] = '\0';
+                fprintf(stderr, "Error: '%s' is not an integer in [0, 2^128).\n", line);
+                rc = EXIT_FAILURE;
+                continue;
+            }
+            print_neighbour(&ctx, x, opts->next_prime);
+            queries++;
+        }
+    }
+    phase_end(PHASE_SIEVE);
+    printf("[%s] queries: %lld in %.3f ms\n", label, queries, get_time(&my_timer));
+
+    free(ctx.window);
+    mem_track(MEM_SEGMENTS, -ctx.window_size);
+    free(ctx.primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * ctx.nprimes);
+    presieve_free(&ctx.presieve);
+    result->numbers = queries;
+    return rc;
+}
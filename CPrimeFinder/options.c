@@ -0,0 +1,328 @@
+//
+//  options.c
+//  CPrimeFinder
+//
+//  Command line: the usage text and parse_command_line, which turns argv into
+//  Options. Kept apart from pprimes.c because it names every mode's options,
+//  and the microbench links pprimes.c without wanting the modes.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+//prints how to call the program
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <max_value (\u22651)> [thread_count (\u22651)]\n", prog);
+    fprintf(stderr, "       %s --factor <n (< 2^128) | - for one per line on stdin>\n", prog);
+    fprintf(stderr, "       %s --is-prime <n (< 2^128) | - for one per line on stdin> [thread_count]\n", prog);
+    fprintf(stderr, "       %s --next|--prev <x (< 2^128) | - for one per line on stdin>\n", prog);
+    fprintf(stderr, "       %s --test <n (any size) | - for one per line on stdin | bench>\n", prog);
+    fprintf(stderr, "       %s --random-primes K --in [lo,hi] [--seed=S] [thread_count]\n", prog);
+    fprintf(stderr, "  --engine=sequential|threaded|segmented\n");
+    fprintf(stderr, "                                force an engine (default: by thread_count)\n");
+    fprintf(stderr, "  --isa=scalar|sse4.2|avx2|avx512\n");
+    fprintf(stderr, "                                force a vector kernel variant (default: best for this CPU)\n");
+    fprintf(stderr, "  --tuples=twin|triplet|quadruplet\n");
+    fprintf(stderr, "                                count prime k-tuples up to max_value\n");
+    fprintf(stderr, "  --ap=Q | --ap=a:q             primes per residue class for every modulus up to Q, or p = a mod q\n");
+    fprintf(stderr, "  --list                        with --tuples, --arith or --ap=a:q, print every tuple, value or prime\n");
+    fprintf(stderr, "  --gaps                        prime gap histogram, first occurrences and maximal gaps\n");
+    fprintf(stderr, "  --goldbach                    smallest p with n - p prime for every even n, hardest cases\n");
+    fprintf(stderr, "  --sum                         sum of primes up to max_value without sieving to it\n");
+    fprintf(stderr, "  --power=K                     with --sum, add p^K instead, 0-2 (default 1); K=2 needs max_value <= 3e13\n");
+    fprintf(stderr, "  --spf                         smallest-factor table to max_value, factors numbers read from stdin\n");
+    fprintf(stderr, "  --factor                      factor n by trial division and Pollard-Brent rho\n");
+    fprintf(stderr, "  --is-prime                    test n with Miller-Rabin, Baillie-PSW above 2^64\n");
+    fprintf(stderr, "  --next, --prev                nearest prime above or below x, by sieving a window next to it\n");
+    fprintf(stderr, "  --test                        Baillie-PSW test of n of any size; bench times modexp by size\n");
+    fprintf(stderr, "  --random-primes K             K primes drawn uniformly from the range given by --in\n");
+    fprintf(stderr, "  --in [lo,hi]                  with --random-primes, the range, 0 <= lo <= hi < 2^128\n");
+    fprintf(stderr, "  --seed=S                      with --random-primes, seed of the random streams (default 0)\n");
+    fprintf(stderr, "  --arith=phi|mu|sigma|mertens  totient, Moebius, divisor sum or Mertens over [from, max_value]\n");
+    fprintf(stderr, "  --from=N                      with --arith, first number of the range (default 1)\n");
+    fprintf(stderr, "  --bench                       repeat the run and report timing statistics\n");
+    fprintf(stderr, "  --warmup=N                    untimed warmup runs for --bench (default 2)\n");
+    fprintf(stderr, "  --reps=N                      timed runs for --bench (default 10)\n");
+    fprintf(stderr, "  --report=json|csv             print one structured record instead of the list\n");
+    fprintf(stderr, "  --trace FILE                  write a Chrome/Perfetto trace of every thread\n");
+    fprintf(stderr, "  --phases                      wall-clock time per phase\n");
+    fprintf(stderr, "  --thread-stats                per-worker load and lock statistics\n");
+    fprintf(stderr, "  --memory                      allocations per subsystem, peak RSS and page faults\n");
+    fprintf(stderr, "  --counters                    hardware performance counters per phase (Linux)\n");
+    fprintf(stderr, "  --segment=N                   numbers per segment (default %lld)\n", DEFAULT_SEGMENT_SIZE);
+    fprintf(stderr, "  --chunk=N                     numbers per work-lock trip, threaded engine (default 1)\n");
+    fprintf(stderr, "  --tune                        search the fastest parameters and save them\n");
+    fprintf(stderr, "  --no-profile                  ignore parameters saved by --tune\n");
+    fprintf(stderr, "  --presieve=N                  small primes in the pre-sieve pattern, 1-7 (default %d)\n",
+            DEFAULT_PRESIEVE_DEPTH);
+}
+
+//matches "--name=value" and returns value, or NULL if arg is a different option
+static const char *option_value(const char *arg, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') return NULL;
+    return arg + len + 1;
+}
+
+//parses a "--name=N" option that must be at least min_value
+static int parse_count_option(const char *value, const char *name, long long min_value, long long *out) {
+    if (!parse_integer_arguments(value, out) || *out < min_value) {
+        fprintf(stderr, "Error: '%s' is not a valid integer \u2265 %lld for %s.\n", value, min_value, name);
+        return 0;
+    }
+    return 1;
+}
+
+//parses --ap=Q (every modulus up to Q) or --ap=a:q (one residue class)
+static int parse_ap_option(const char *value, Options *opts) {
+    const char *colon = strchr(value, ':');
+    if (!colon) {
+        return parse_integer_arguments(value, &opts->ap_moduli) && opts->ap_moduli >= 1
+               && opts->ap_moduli <= AP_MAX_MODULUS;
+    }
+    char residue[32];
+    size_t len = (size_t)(colon - value);
+    if (len == 0 || len >= sizeof(residue)) return 0;
+    memcpy(residue, value, len);
+    residue[len] = '\0';
+    if (!parse_integer_arguments(residue, &opts->ap_residue) || !parse_integer_arguments(colon + 1, &opts->ap_modulus)
+        || opts->ap_modulus < 1 || opts->ap_residue < 0) {
+        return 0;
+    }
+    opts->ap_residue %= opts->ap_modulus;
+    return 1;
+}
+
+//parses --in [lo,hi] or --in lo,hi into the --random-primes range
+static int parse_range_option(const char *value, Options *opts) {
+    char text[2 * U128_DIGITS + 8];
+    size_t len = strlen(value);
+    if (len >= sizeof(text)) return 0;
+    memcpy(text, value, len + 1);
+    char *lo = text;
+    if (*lo == '[') lo++;
+    if (len && text[len - 1] == ']') text[len - 1] = '\0';
+    char *comma = strchr(lo, ',');
+    if (!comma) return 0;
+    *comma = '\0';
+    if (!parse_u128(lo, &opts->random_lo) || !parse_u128(comma + 1, &opts->random_hi)) return 0;
+    opts->random_range = 1;
+    return opts->random_lo <= opts->random_hi;
+}
+
+//parsing through the command line. calls parse_integer_arguments to check integers
+int parse_command_line(int argc, const char *argv[], Options *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->thread_count = 2; // default value
+    opts->engine = ENGINE_AUTO;
+    opts->bench_warmup = 2;
+    opts->bench_reps = 10;
+    opts->segment_size = DEFAULT_SEGMENT_SIZE;
+    opts->presieve_depth = DEFAULT_PRESIEVE_DEPTH;
+    opts->chunk_size = 1;
+    opts->sum_power = 1;
+    opts->range_lo = 1;
+
+    const char *positional[2];
+    int npositional = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value;
+        if (strncmp(arg, "--", 2) != 0) {
+            if (npositional == 2) {
+                print_usage(argv[0]);
+                return 0;
+            }
+            positional[npositional++] = arg;
+        } else if (strcmp(arg, "--bench") == 0) {
+            opts->bench = 1;
+        } else if (strcmp(arg, "--tune") == 0) {
+            opts->tune = 1;
+        } else if (strcmp(arg, "--no-profile") == 0) {
+            opts->no_profile = 1;
+        } else if (strcmp(arg, "--phases") == 0) {
+            opts->phases = 1;
+        } else if (strcmp(arg, "--thread-stats") == 0) {
+            opts->thread_stats = 1;
+        } else if (strcmp(arg, "--gaps") == 0) {
+            opts->gaps = 1;
+        } else if (strcmp(arg, "--goldbach") == 0) {
+            opts->goldbach = 1;
+        } else if (strcmp(arg, "--sum") == 0) {
+            opts->sum = 1;
+        } else if ((value = option_value(arg, "--power")) != NULL) {
+            long long power;
+            if (!parse_integer_arguments(value, &power) || power < 0 || power > 2) {
+                fprintf(stderr, "Error: --power must be 0, 1 or 2.\n");
+                return 0;
+            }
+            opts->sum_power = (int)power;
+        } else if (strcmp(arg, "--spf") == 0) {
+            opts->spf = 1;
+        } else if (strcmp(arg, "--factor") == 0) {
+            opts->factor = 1;
+        } else if (strcmp(arg, "--is-prime") == 0) {
+            opts->primality = 1;
+        } else if (strcmp(arg, "--next") == 0) {
+            opts->next_prime = 1;
+        } else if (strcmp(arg, "--prev") == 0) {
+            opts->prev_prime = 1;
+        } else if (strcmp(arg, "--test") == 0) {
+            opts->bignum_test = 1;
+        } else if (strcmp(arg, "--list") == 0) {
+            opts->list = 1;
+        } else if (strcmp(arg, "--memory") == 0) {
+            opts->memory = 1;
+        } else if (strcmp(arg, "--counters") == 0) {
+            opts->counters = 1;
+        } else if ((value = option_value(arg, "--warmup")) != NULL) {
+            if (!parse_count_option(value, "--warmup", 0, &opts->bench_warmup)) return 0;
+        } else if ((value = option_value(arg, "--reps")) != NULL) {
+            if (!parse_count_option(value, "--reps", 1, &opts->bench_reps)) return 0;
+        } else if ((value = option_value(arg, "--segment")) != NULL) {
+            if (!parse_count_option(value, "--segment", 64, &opts->segment_size)) return 0;
+            opts->explicit_params |= EXPLICIT_SEGMENT;
+        } else if ((value = option_value(arg, "--chunk")) != NULL) {
+            if (!parse_count_option(value, "--chunk", 1, &opts->chunk_size)) return 0;
+            opts->explicit_params |= EXPLICIT_CHUNK;
+        } else if ((value = option_value(arg, "--presieve")) != NULL) {
+            long long depth;
+            if (!parse_count_option(value, "--presieve", 1, &depth)) return 0;
+            if (depth > 7) {
+                fprintf(stderr, "Error: --presieve must be between 1 and 7.\n");
+                return 0;
+            }
+            opts->presieve_depth = (int)depth;
+            opts->explicit_params |= EXPLICIT_PRESIEVE;
+        } else if (strcmp(arg, "--random-primes") == 0 && i + 1 < argc) {
+            if (!parse_count_option(argv[++i], "--random-primes", 1, &opts->random_primes)) return 0;
+        } else if ((value = option_value(arg, "--random-primes")) != NULL) {
+            if (!parse_count_option(value, "--random-primes", 1, &opts->random_primes)) return 0;
+        } else if (strcmp(arg, "--in") == 0 && i + 1 < argc) {
+            if (!parse_range_option(argv[++i], opts)) {
+                fprintf(stderr, "Error: --in takes [lo,hi] with 0 <= lo <= hi < 2^128.\n");
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--in")) != NULL) {
+            if (!parse_range_option(value, opts)) {
+                fprintf(stderr, "Error: --in takes [lo,hi] with 0 <= lo <= hi < 2^128.\n");
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--seed")) != NULL) {
+            u128 seed;
+            if (!parse_u128(value, &seed) || (seed >> 64) != 0) {
+                fprintf(stderr, "Error: --seed must be an integer in [0, 2^64).\n");
+                return 0;
+            }
+            opts->seed = (unsigned long long)seed;
+        } else if (strcmp(arg, "--trace") == 0 && i + 1 < argc) {
+            opts->trace_path = argv[++i];
+        } else if ((value = option_value(arg, "--trace")) != NULL) {
+            opts->trace_path = value;
+        } else if ((value = option_value(arg, "--report")) != NULL) {
+            if (strcmp(value, "json") == 0) {
+                opts->report = REPORT_JSON;
+            } else if (strcmp(value, "csv") == 0) {
+                opts->report = REPORT_CSV;
+            } else {
+                fprintf(stderr, "Error: unknown report format '%s'.\n", value);
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--tuples")) != NULL) {
+            if (!parse_tuple_kind(value, &opts->tuples)) {
+                fprintf(stderr, "Error: unknown tuple kind '%s'.\n", value);
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--arith")) != NULL) {
+            if (!parse_arith(value, &opts->arith)) {
+                fprintf(stderr, "Error: unknown arithmetic function '%s'.\n", value);
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--ap")) != NULL) {
+            if (!parse_ap_option(value, opts)) {
+                fprintf(stderr, "Error: --ap takes Q (1-%d) or a:q.\n", AP_MAX_MODULUS);
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--from")) != NULL) {
+            if (!parse_count_option(value, "--from", 1, &opts->range_lo)) return 0;
+        } else if ((value = option_value(arg, "--isa")) != NULL) {
+            if (!parse_isa(value, &opts->isa)) {
+                fprintf(stderr, "Error: unknown instruction set '%s'.\n", value);
+                return 0;
+            }
+        } else if ((value = option_value(arg, "--engine")) != NULL) {
+            if (strcmp(value, "sequential") == 0) {
+                opts->engine = ENGINE_SEQUENTIAL;
+            } else if (strcmp(value, "threaded") == 0) {
+                opts->engine = ENGINE_THREADED;
+            } else if (strcmp(value, "segmented") == 0) {
+                opts->engine = ENGINE_SEGMENTED;
+            } else {
+                fprintf(stderr, "Error: unknown engine '%s'.\n", value);
+                return 0;
+            }
+            opts->explicit_params |= EXPLICIT_ENGINE;
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'.\n", arg);
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    //--random-primes takes no max_value, so its one positional is the thread count
+    const char *threads_arg = npositional == 2 ? positional[1] : NULL;
+    if (opts->random_primes) {
+        if (!opts->random_range) {
+            fprintf(stderr, "Error: --random-primes needs a range, --in [lo,hi].\n");
+            return 0;
+        }
+        if (npositional == 2) {
+            print_usage(argv[0]);
+            return 0;
+        }
+        opts->max_value = 1;
+        threads_arg = npositional ? positional[0] : NULL;
+    } else if (npositional < 1) {
+        print_usage(argv[0]);
+        return 0;
+    } else if (opts->bignum_test) {
+        //parsed by run_bignum_test, which may need thousands of digits
+        opts->max_value = 1;
+        opts->number_text = positional[0];
+    } else if (opts->factor || opts->primality || opts->next_prime || opts->prev_prime) {
+        //the operand may not fit max_value; "-" reads them from stdin instead
+        opts->max_value = 1;
+        opts->number_stdin = strcmp(positional[0], "-") == 0;
+        if (!opts->number_stdin && (!parse_u128(positional[0], &opts->number) || (opts->factor && opts->number == 0))) {
+            fprintf(stderr, "Error: '%s' is not a valid integer in [%d, 2^128).\n", positional[0], opts->factor);
+            return 0;
+        }
+    } else if (!parse_integer_arguments(positional[0], &opts->max_value) || opts->max_value < 1) {
+        fprintf(stderr, "Error: '%s' is not a valid integer \u2265 1 for max_value.\n", positional[0]);
+        return 0;
+    }
+    if (threads_arg) {
+        if (!parse_integer_arguments(threads_arg, &opts->thread_count) || opts->thread_count < 1) {
+            fprintf(stderr, "Error: '%s' is not a valid integer ≥ 1 for thread_count.\n", threads_arg);
+            return 0;
+        }
+        opts->explicit_params |= EXPLICIT_THREADS;
+    }
+    //past this the 128-bit sum of squares would wrap; p^0 and p^1 fit for any x
+    if (opts->sum && opts->sum_power == 2 && opts->max_value > SUM_SQUARES_MAX) {
+        fprintf(stderr, "Error: --sum --power=2 is limited to max_value <= %lld, where the sum still fits in 128 bits.\n",
+                SUM_SQUARES_MAX);
+        return 0;
+    }
+    if (opts->range_lo > opts->max_value) {
+        fprintf(stderr, "Error: --from=%lld is past max_value %lld.\n", opts->range_lo, opts->max_value);
+        return 0;
+    }
+    if (opts->engine == ENGINE_AUTO) {
+        opts->engine = (opts->thread_count == 1) ? ENGINE_SEQUENTIAL : ENGINE_THREADED;
+    }
+    return 1;
+}
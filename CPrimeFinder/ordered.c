@@ -0,0 +1,93 @@
+//
+//  ordered.c
+//  CPrimeFinder
+//
+//  In-order delivery of per-segment results for the modes that list what they
+//  find. for_each_segment finishes segments out of order; each worker hands
+//  its result to ordered_put, which holds it until every earlier segment has
+//  been delivered and then passes it, under the lock, to the mode's callback.
+//  A worker more than a few segments per thread ahead of the oldest
+//  undelivered one waits, so the held results stay bounded however long the
+//  range is. Text output, the common case, uses TextBuf and ordered_write_text.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+//segments a worker may run ahead of the oldest undelivered one, per thread
+#define ORDERED_WINDOW_PER_THREAD 4
+
+void ordered_init(OrderedOutput *o, int nthreads, OrderedFn deliver, void *ctx) {
+    memset(o, 0, sizeof(*o));
+    o->window = (long long)(nthreads < 1 ? 1 : nthreads) * ORDERED_WINDOW_PER_THREAD;
+    o->items = (void **)calloc((size_t)o->window, sizeof(void *));
+    o->ready = (unsigned char *)calloc((size_t)o->window, 1);
+    if (!o->items || !o->ready || pthread_mutex_init(&o->lock, NULL) != 0
+        || pthread_cond_init(&o->advanced, NULL) != 0) {
+        fprintf(stderr, "Error: failed to set up ordered output\n");
+        exit(EXIT_FAILURE);
+    }
+    o->deliver = deliver;
+    o->ctx = ctx;
+}
+
+void ordered_free(OrderedOutput *o) {
+    pthread_cond_destroy(&o->advanced);
+    pthread_mutex_destroy(&o->lock);
+    free(o->items);
+    free(o->ready);
+}
+
+//Hands over the result of segment index, then delivers every result that is next in order
+void ordered_put(OrderedOutput *o, long long index, void *item) {
+    pthread_mutex_lock(&o->lock);
+    while (index >= o->next + o->window) pthread_cond_wait(&o->advanced, &o->lock);
+    long long slot = index % o->window;
+    o->items[slot] = item;
+    o->ready[slot] = 1;
+    long long before = o->next;
+    for (slot = o->next % o->window; o->ready[slot]; slot = o->next % o->window) {
+        o->ready[slot] = 0;
+        o->deliver(o->ctx, o->items[slot]);
+        o->next++;
+    }
+    if (o->next != before) pthread_cond_broadcast(&o->advanced);
+    pthread_mutex_unlock(&o->lock);
+}
+
+//An empty text buffer; exits if it cannot be allocated
+TextBuf *text_new(void) {
+    TextBuf *t = (TextBuf *)calloc(1, sizeof(TextBuf));
+    if (!t) {
+        fprintf(stderr, "Error: failed to allocate output text\n");
+        exit(EXIT_FAILURE);
+    }
+    return t;
+}
+
+//Makes room for more bytes past t->len
+void text_reserve(TextBuf *t, size_t more) {
+    if (t->len + more <= t->cap) return;
+    size_t grown = t->cap ? t->cap * 2 : 4096;
+    while (grown < t->len + more) grown *= 2;
+    char *text = (char *)realloc(t->text, grown);
+    if (!text) {
+        fprintf(stderr, "Error: failed to allocate output text\n");
+        exit(EXIT_FAILURE);
+    }
+    t->text = text;
+    t->cap = grown;
+}
+
+//OrderedFn for TextBuf results: writes the text to stdout and frees it
+void ordered_write_text(void *ctx, void *item) {
+    (void)ctx;
+    TextBuf *t = (TextBuf *)item;
+    fwrite(t->text, 1, t->len, stdout);
+    free(t->text);
+    free(t);
+}
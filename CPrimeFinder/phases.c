@@ -0,0 +1,147 @@
+//
+//  phases.c
+//  CPrimeFinder
+//
+//  Per-phase wall-clock breakdown (--phases). Phases are timed with the CPU's
+//  cycle/tick counter, which costs a few cycles to read, and converted to time
+//  with a rate calibrated against CLOCK_MONOTONIC once at startup. Phases nest:
+//  starting one pauses the enclosing phase until it ends. Only the thread that
+//  called phases_init records phases; calls from any other thread, such as the
+//  microbench workers running a kernel, are ignored.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define MAX_PHASE_DEPTH 8
+
+static const char *phase_names[NUM_PHASES] = {
+    "parse", "alloc", "first-touch", "base-sieve", "sieve", "count", "format", "write"
+};
+
+static unsigned long long phase_ticks[NUM_PHASES];
+static Phase phase_stack[MAX_PHASE_DEPTH];
+static unsigned long long phase_started[MAX_PHASE_DEPTH];
+static unsigned long long phase_opened[MAX_PHASE_DEPTH];  // for the trace, which shows nesting
+static int phase_depth = 0;
+static double ns_per_tick = 0.0;
+static pthread_t phase_thread;
+static int phase_thread_set = 0;
+
+const char *phase_name(Phase phase) {
+    return phase_names[phase];
+}
+
+//Raw tick counter: TSC on x86, the virtual counter on arm64, else the monotonic clock
+unsigned long long tsc_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    unsigned long long ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+#endif
+}
+
+static double monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+//Measures the tick rate over ~5 ms of CLOCK_MONOTONIC
+void tsc_calibrate(void) {
+    double ns0 = monotonic_ns();
+    unsigned long long t0 = tsc_now();
+    double ns1;
+    do {
+        ns1 = monotonic_ns();
+    } while (ns1 - ns0 < 5e6);
+    unsigned long long t1 = tsc_now();
+    ns_per_tick = (t1 > t0) ? (ns1 - ns0) / (double)(t1 - t0) : 1.0;
+}
+
+double tsc_to_ns(unsigned long long ticks) {
+    if (ns_per_tick == 0.0) tsc_calibrate();
+    return (double)ticks * ns_per_tick;
+}
+
+//Makes the calling thread the one whose phases are recorded
+void phases_init(void) {
+    phase_thread = pthread_self();
+    phase_thread_set = 1;
+}
+
+static int on_phase_thread(void) {
+    return phase_thread_set && pthread_equal(pthread_self(), phase_thread);
+}
+
+//Credits ticks measured outside phase_begin/phase_end (used for parsing)
+void phase_add(Phase phase, unsigned long long start, unsigned long long end) {
+    if (!on_phase_thread()) return;
+    phase_ticks[phase] += end - start;
+}
+
+//Starts phase, pausing whatever phase encloses it
+void phase_begin(Phase phase) {
+    if (!on_phase_thread()) return;
+    unsigned long long now = tsc_now();
+    if (phase_depth > 0) {
+        Phase outer = phase_stack[phase_depth - 1];
+        phase_ticks[outer] += now - phase_started[phase_depth - 1];
+        counters_phase_end(outer);
+    }
+    if (phase_depth == MAX_PHASE_DEPTH) {
+        fprintf(stderr, "Error: phases nested too deeply\n");
+        exit(EXIT_FAILURE);
+    }
+    phase_stack[phase_depth] = phase;
+    counters_phase_begin(phase);
+    phase_opened[phase_depth] = now;
+    phase_started[phase_depth++] = tsc_now();
+}
+
+//Ends the innermost phase and resumes the one around it
+void phase_end(Phase phase) {
+    if (!on_phase_thread()) return;
+    unsigned long long now = tsc_now();
+    if (phase_depth == 0 || phase_stack[phase_depth - 1] != phase) {
+        fprintf(stderr, "Error: phase '%s' ended out of order\n", phase_names[phase]);
+        exit(EXIT_FAILURE);
+    }
+    phase_depth--;
+    phase_ticks[phase] += now - phase_started[phase_depth];
+    counters_phase_end(phase);
+    trace_event(phase_names[phase], phase_opened[phase_depth], now, 0);
+    if (phase_depth > 0) {
+        counters_phase_begin(phase_stack[phase_depth - 1]);
+        phase_started[phase_depth - 1] = tsc_now();
+    }
+}
+
+double phase_ms(Phase phase) {
+    return tsc_to_ns(phase_ticks[phase]) / 1e6;
+}
+
+void phases_report(void) {
+    double total = 0.0;
+    for (int p = 0; p < NUM_PHASES; ++p) total += phase_ms((Phase)p);
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        double ms = phase_ms((Phase)p);
+        printf("[phases] %-11s %12.3f ms %6.1f%%\n", phase_names[p], ms,
+               total > 0.0 ? 100.0 * ms / total : 0.0);
+    }
+    printf("[phases] %-11s %12.3f ms\n", "total", total);
+}
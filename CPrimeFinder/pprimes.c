@@ -7,7 +7,6 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <string.h>
 #include <errno.h>
 #include <limits.h>
 #include <ctype.h>
@@ -15,18 +14,15 @@
 #include <pthread.h>
 #include <unistd.h>
 
-//Timer Declaration
-struct Timer {
-    struct timespec start;
-};
+#include "pprimes.h"
 
 //Begin timer
-static void timer_start(struct Timer *my_timer) {
+void timer_start(struct Timer *my_timer) {
     clock_gettime(CLOCK_MONOTONIC, &my_timer->start);
 }
 
 //Get time since start
-static double get_time(const struct Timer *t) {
+double get_time(const struct Timer *t) {
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
     time_t sec = now.tv_sec - t->start.tv_sec;
@@ -50,32 +46,62 @@ int parse_integer_arguments(const char *input, long long *outValue) {
     return 1;
 }
 
-//parsing through the command line. calls parse_integer_arguments to check integers
-int parse_command_line(int argc, const char *argv[], long long *max_value, long long *thread_count) {
-    if (argc < 2 || argc > 3) {
-        fprintf(stderr, "Usage: %s <max_value (\u22651)> [thread_count (\u22651)]\n", argv[0]);
-        return 0;
-    }
-    if (!parse_integer_arguments(argv[1], max_value) || *max_value < 1) {
-        fprintf(stderr, "Error: '%s' is not a valid integer \u2265 1 for max_value.\n", argv[1]);
-        return 0;
+//Odd primes below 2^16 for is_prime, which cover every n below 2^32: p divides
+//an n below 2^64 exactly when n * inverse mod 2^64 <= bound, so the trial
+//division loop multiplies and compares instead of dividing
+typedef struct {
+    unsigned long long inverse;
+    unsigned long long bound;
+    unsigned long long p;
+} TrialDivisor;
+
+static TrialDivisor *trial_divisors;
+static long long ntrial_divisors;
+static long long first_past_filter;   // first entry above SMALL_PRIME_MAX
+static pthread_once_t trial_divisors_once = PTHREAD_ONCE_INIT;
+
+static void build_trial_divisors(void) {
+    long long n = 0;
+    long long *primes = sieve_base_primes(TRIAL_DIVISOR_LIMIT, &n);
+    trial_divisors = (TrialDivisor *)malloc(sizeof(TrialDivisor) * (size_t)n);
+    if (!trial_divisors) {
+        fprintf(stderr, "Error: failed to allocate the trial division table\n");
+        exit(EXIT_FAILURE);
     }
-    *thread_count = 2; // default value
-    if (argc == 3) {
-        if (!parse_integer_arguments(argv[2], thread_count) || *thread_count < 1) {
-            fprintf(stderr, "Error: '%s' is not a valid integer ≥ 1 for thread_count.\n", argv[2]);
-            return 0;
-        }
+    for (long long k = 0; k < n; ++k) {
+        unsigned long long p = (unsigned long long)primes[k];
+        unsigned long long inv = p;
+        for (int i = 0; i < 5; ++i) inv *= 2 - p * inv;
+        trial_divisors[k].inverse = inv;
+        trial_divisors[k].bound = ~0ULL / p;
+        trial_divisors[k].p = p;
+        if (p <= SMALL_PRIME_MAX) first_past_filter = k + 1;
     }
-    return 1;
+    ntrial_divisors = n;
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * n);
 }
 
 //check if a number is prime
-static int is_prime(long long n) {
+int is_prime(long long n) {
     if (n < 2) return 0;
     if (n == 2) return 1;
     if ((n & 1LL) == 0) return 0; //checks the last bit to see if its an even number
-    for (long long d = 3; d <= n / d; d += 2) {
+    pthread_once(&trial_divisors_once, build_trial_divisors);
+    long long k = 0;
+    //the odd primes up to SMALL_PRIME_MAX are tested together by the vector filter
+    if (n > SMALL_PRIME_MAX && n <= 0xFFFFFFFFLL) {
+        if (simd_small_factor((unsigned int)n)) return 0;
+        k = first_past_filter;
+    }
+    unsigned long long u = (unsigned long long)n;
+    for (; k < ntrial_divisors; ++k) {
+        const TrialDivisor *t = &trial_divisors[k];
+        if (t->p * t->p > u) return 1;
+        if (u * t->inverse <= t->bound) return 0;
+    }
+    //past the table, n is above 2^32: plain division by the odd numbers that remain
+    for (long long d = TRIAL_DIVISOR_LIMIT + 1; d <= n / d; d += 2) {
         if (n % d == 0) return 0;
     }
     return 1;
@@ -89,26 +115,83 @@ unsigned char *alloc_results(long long max_value) {
         fprintf(stderr, "Error: failed to allocate %zu bytes for results.\n", bytes);
         exit(EXIT_FAILURE);
     }
+    mem_track(MEM_RESULTS, (long long)bytes);
+    //calloc succeeds lazily, so say so now rather than when the sieve runs out of memory
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page > 0 && bytes > (size_t)pages * (size_t)page) {
+        fprintf(stderr, "Warning: the results array (%zu bytes) is larger than physical memory.\n", bytes);
+    }
     return arr;
 }
 
+//Releases an array from alloc_results
+void free_results(unsigned char *arr, long long max_value) {
+    free(arr);
+    mem_track(MEM_RESULTS, -(max_value + 1));
+}
+
+//Writes one byte per page so the page faults happen here instead of in the engine
+void first_touch(unsigned char *arr, size_t bytes) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) page = 4096;
+    for (size_t i = 0; i < bytes; i += (size_t)page) {
+        ((volatile unsigned char *)arr)[i] = 0;
+    }
+}
+
+//Counts the primes in [lo, hi)
+long long count_primes_range(const unsigned char *is_prime, long long lo, long long hi) {
+    if (hi <= lo) return 0;
+    return simd_count_nonzero(is_prime + lo, hi - lo);
+}
+
 //Counts the primes
-void count_and_print(const unsigned char *is_prime, long long max_value, const char *label) {
-    long long count = 0;
-    for (long long n = 2; n <= max_value; ++n) {
-        if (is_prime[n]) {
-            count++;
-        }
+long long count_primes(const unsigned char *is_prime, long long max_value) {
+    return count_primes_range(is_prime, 2, max_value + 1);
+}
+
+//Formats " p" for each prime from *next up to hi into buf, stopping early when
+//buf is nearly full; *next is left at the first number not yet formatted
+size_t format_primes(char *buf, size_t cap, const unsigned char *is_prime, long long *next, long long hi) {
+    size_t len = 0;
+    long long n = *next;
+    for (; len + 21 <= cap; ++n) {
+        n = simd_next_nonzero(is_prime, n, hi);
+        if (n >= hi) break;
+        char digits[20];
+        int k = 0;
+        unsigned long long v = (unsigned long long)n;
+        do {
+            digits[k++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v);
+        buf[len++] = ' ';
+        while (k) buf[len++] = digits[--k];
     }
-    
-    printf("[%s] total primes: %lld\n", label, count);
-    printf("[%s] list:", label);
-    for (long long n = 2; n <= max_value; ++n) {
-        if (is_prime[n]) {
-            printf(" %lld", n);
-        }
+    *next = n;
+    return len;
+}
+
+//Prints each prime in [lo, hi) preceded by a space
+void print_prime_list(FILE *out, const unsigned char *is_prime, long long lo, long long hi) {
+    char *buf = (char *)malloc(OUTPUT_BUFFER_SIZE);
+    if (!buf) {
+        fprintf(stderr, "Error: failed to allocate output buffer\n");
+        exit(EXIT_FAILURE);
     }
-    printf("\n");
+    mem_track(MEM_OUTPUT, OUTPUT_BUFFER_SIZE);
+    long long n = lo;
+    while (n < hi) {
+        phase_begin(PHASE_FORMAT);
+        size_t len = format_primes(buf, OUTPUT_BUFFER_SIZE, is_prime, &n, hi);
+        phase_end(PHASE_FORMAT);
+        unsigned long long t0 = tsc_now();
+        fwrite(buf, 1, len, out);
+        trace_event("write", t0, tsc_now(), (long long)len);
+    }
+    free(buf);
+    mem_track(MEM_OUTPUT, -OUTPUT_BUFFER_SIZE);
 }
 
 //Runs the program sequentially if specified threads is 1
@@ -122,35 +205,65 @@ void run_sequential(long long max_value, unsigned char *is_prime_arr) {
 typedef struct {
     long long max_value;
     long long next_n;
+    long long chunk;          // numbers taken per trip through the lock
     pthread_mutex_t lock;
     unsigned char *is_prime_arr;
 } ThreadWork;
 
+//Each thread gets the shared work plus its own id
+typedef struct {
+    ThreadWork *work;
+    int thread_id;
+} ThreadArg;
+
 //This is the function that the threads run
 static void* thread_work_function(void *arg) {
-    ThreadWork *w = (ThreadWork *)arg;
+    ThreadWork *w = ((ThreadArg *)arg)->work;
+    WorkerStats *stats = thread_stats_worker(((ThreadArg *)arg)->thread_id);
+    int tracing = trace_enabled();
+    int timed = stats || tracing;
+    unsigned long long started = timed ? tsc_now() : 0, lock_ticks = 0;
+    counters_thread_begin();
     for (;;) {
-        long long n;
+        long long n, end;
+        unsigned long long t0 = timed ? tsc_now() : 0;
         pthread_mutex_lock(&(w->lock));
+        unsigned long long t1 = timed ? tsc_now() : 0;
         if (w->next_n > w->max_value) {
             pthread_mutex_unlock(&w->lock);
             break;
         }
-        n = w->next_n++;
+        n = w->next_n;
+        w->next_n += w->chunk;
         pthread_mutex_unlock(&w->lock);
+        unsigned long long t2 = timed ? tsc_now() : 0;
+        if (stats) {
+            thread_stats_lock(stats, t1 - t0, t2 - t1);
+            lock_ticks += t2 - t0;
+            stats->items++;
+        }
+        if (tracing) trace_event("lock wait", t0, t1, n);
 
-        if (is_prime(n)) {
-            w->is_prime_arr[n] = 1;
+        end = (n + w->chunk - 1 < w->max_value) ? n + w->chunk - 1 : w->max_value;
+        for (long long k = n; k <= end; ++k) {
+            if (is_prime(k)) {
+                w->is_prime_arr[k] = 1;
+            }
         }
+        if (tracing) trace_event("chunk", t2, tsc_now(), n);
     }
+    counters_thread_end();
+    trace_thread_end();
+    if (stats) stats->busy_ticks += tsc_now() - started - lock_ticks;
     return NULL;
 }
 
 //Runs the program when multiple threads are used
-void run_threaded(long long max_value, long long thread_count, unsigned char *is_prime_arr) {
+void run_threaded(long long max_value, long long thread_count, long long chunk, unsigned char *is_prime_arr) {
     ThreadWork work;
     work.max_value = max_value;
     work.next_n = 2;
+    work.chunk = (chunk < 1) ? 1 : chunk;
     work.is_prime_arr = is_prime_arr;
     if (pthread_mutex_init(&work.lock, NULL) != 0) {
         fprintf(stderr, "Error: failed to initialize mutex\n");
@@ -161,16 +274,23 @@ void run_threaded(long long max_value, long long thread_count, unsigned char *is
     if (nthreads < 1) nthreads = 1;
 
     pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * (size_t)nthreads);
-    if (!threads) {
+    ThreadArg *args = (ThreadArg *)malloc(sizeof(ThreadArg) * (size_t)nthreads);
+    if (!threads || !args) {
         fprintf(stderr, "Error: failed to allocate thread handles\n");
         pthread_mutex_destroy(&work.lock);
         exit(EXIT_FAILURE);
     }
+    long long handle_bytes = (long long)(sizeof(pthread_t) + sizeof(ThreadArg)) * nthreads;
+    mem_track(MEM_THREADS, handle_bytes);
+    thread_stats_prepare(nthreads);
 
     for (int i = 0; i < nthreads; ++i) {
-        int rc = pthread_create(&threads[i], NULL, thread_work_function, &work);
+        args[i].work = &work;
+        args[i].thread_id = i;
+        int rc = pthread_create(&threads[i], NULL, thread_work_function, &args[i]);
         if (rc != 0) {
             fprintf(stderr, "Error: pthread_create failed (%d)\n", rc);
+            free(args);
             free(threads);
             pthread_mutex_destroy(&work.lock);
             exit(EXIT_FAILURE);
@@ -181,34 +301,138 @@ void run_threaded(long long max_value, long long thread_count, unsigned char *is
         pthread_join(threads[i], NULL);
     }
 
+    free(args);
     free(threads);
+    mem_track(MEM_THREADS, -handle_bytes);
     pthread_mutex_destroy(&work.lock);
 }
 
-// Main function
-int main(int argc, const char *argv[]) {
-    long long max_value = 0, thread_count = 2;
-    if (!parse_command_line(argc, argv, &max_value, &thread_count)) return EXIT_FAILURE;
+//Runs whichever engine the options select
+void run_engine(const Options *opts, unsigned char *is_prime_arr) {
+    if (opts->engine == ENGINE_SEQUENTIAL) {
+        run_sequential(opts->max_value, is_prime_arr);
+    } else if (opts->engine == ENGINE_SEGMENTED) {
+        run_segmented(opts, is_prime_arr);
+    } else {
+        run_threaded(opts->max_value, opts->thread_count, opts->chunk_size, is_prime_arr);
+    }
+}
+
+//Label used in the output lines for the selected engine
+const char *engine_label(const Options *opts) {
+    switch (opts->engine) {
+        case ENGINE_SEQUENTIAL: return "sequential";
+        case ENGINE_SEGMENTED: return "segmented";
+        default: return "threaded";
+    }
+}
+
+#ifndef PPRIMES_NO_MAIN
+//Prints the count and the list of primes
+static void print_results(const unsigned char *is_prime, long long max_value, const char *label, long long count) {
+    printf("[%s] total primes: %lld\n", label, count);
+    printf("[%s] list:", label);
+    print_prime_list(stdout, is_prime, 2, max_value + 1);
+    printf("\n");
+    fflush(stdout);
+}
 
-    printf("max_value: %lld\nthread_count: %lld\n", max_value, thread_count);
+//Fills the results array with the selected engine, then prints the primes or the report
+static int run_prime_list(const Options *opts, RunResult *result) {
+    phase_begin(PHASE_ALLOC);
+    unsigned char *is_prime_arr = alloc_results(opts->max_value);
+    phase_end(PHASE_ALLOC);
 
-    unsigned char *is_prime_arr = alloc_results(max_value);
+    phase_begin(PHASE_FIRST_TOUCH);
+    first_touch(is_prime_arr, (size_t)(opts->max_value + 1));
+    phase_end(PHASE_FIRST_TOUCH);
 
     struct Timer my_timer;
     timer_start(&my_timer);
 
-    if (thread_count == 1) {
-        run_sequential(max_value, is_prime_arr);
+    phase_begin(PHASE_SIEVE);
+    run_engine(opts, is_prime_arr);
+    phase_end(PHASE_SIEVE);
+
+    result->elapsed_ms = get_time(&my_timer);
+    const char *label = engine_label(opts);
+
+    phase_begin(PHASE_COUNT);
+    result->total_primes = count_primes(is_prime_arr, opts->max_value);
+    phase_end(PHASE_COUNT);
+
+    if (opts->report) {
+        write_report(stdout, opts, result);
     } else {
-        run_threaded(max_value, thread_count, is_prime_arr);
+        phase_begin(PHASE_WRITE);
+        print_results(is_prime_arr, opts->max_value, label, result->total_primes);
+        phase_end(PHASE_WRITE);
+        printf("[%s] elapsed: %.3f ms\n", label, result->elapsed_ms);
     }
 
-    double ms = get_time(&my_timer);
-    const char *label = (thread_count == 1) ? "sequential" : "threaded";
-    count_and_print(is_prime_arr, max_value, label);
-    printf("[%s] elapsed: %.3f ms\n", label, ms);
-
-    free(is_prime_arr);
+    free_results(is_prime_arr, opts->max_value);
     return EXIT_SUCCESS;
 }
 
+typedef int (*ModeFn)(const Options *opts, RunResult *result);
+
+//The mode the options select; listing the primes when no mode option is given
+static ModeFn selected_mode(const Options *opts) {
+    if (opts->bench) return run_bench;
+    if (opts->tuples) return run_tuples;
+    if (opts->gaps) return run_gaps;
+    if (opts->goldbach) return run_goldbach;
+    if (opts->sum) return run_prime_sum;
+    if (opts->spf) return run_spf;
+    if (opts->arith) return run_arith;
+    if (opts->ap_moduli || opts->ap_modulus) return run_progressions;
+    if (opts->factor) return run_factor;
+    if (opts->primality) return run_primality;
+    if (opts->next_prime || opts->prev_prime) return run_next_prime;
+    if (opts->bignum_test) return run_bignum_test;
+    if (opts->random_primes) return run_random_primes;
+    return run_prime_list;
+}
+
+// Main function
+int main(int argc, const char *argv[]) {
+    phases_init();
+    unsigned long long parse_start = tsc_now();
+    Options opts;
+    if (!parse_command_line(argc, argv, &opts)) return EXIT_FAILURE;
+    if (!simd_init(opts.isa)) return EXIT_FAILURE;
+    phase_add(PHASE_PARSE, parse_start, tsc_now());
+    if (opts.phases || opts.report) tsc_calibrate();
+    if (opts.tune) return run_tune(&opts);
+    if (!opts.no_profile) tune_apply_profile(&opts);
+
+    //only the prime list fills in the structured record
+    ModeFn mode = selected_mode(&opts);
+    if (opts.report && mode != run_prime_list) {
+        fprintf(stderr, "Error: --report only applies to the prime list, not to this mode.\n");
+        return EXIT_FAILURE;
+    }
+
+    //the modes that take a single operand have no max_value to print
+    int single_operand = opts.factor || opts.primality || opts.next_prime || opts.prev_prime || opts.bignum_test
+                         || opts.random_primes;
+    if (!opts.report && !single_operand) printf("max_value: %lld\nthread_count: %lld\n", opts.max_value, opts.thread_count);
+
+    if (opts.counters) counters_init();
+    if (opts.thread_stats) thread_stats_init();
+    if (opts.trace_path) trace_init(opts.trace_path);
+
+    RunResult result = { 0, 0.0, opts.max_value };
+    int rc = mode(&opts, &result);
+
+    //the structured record already carries these
+    if (!opts.report) {
+        if (opts.phases) phases_report();
+        thread_stats_report();
+        if (opts.memory) memory_report();
+        counters_report(result.numbers);
+    }
+    trace_write();
+    return rc;
+}
+#endif /* PPRIMES_NO_MAIN */
@@ -9,5 +9,470 @@
 #define pprimes_h
 
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef unsigned __int128 u128;
+
+//Which engine fills the results array
+typedef enum {
+    ENGINE_AUTO,        // sequential for 1 thread, threaded otherwise
+    ENGINE_SEQUENTIAL,
+    ENGINE_THREADED,
+    ENGINE_SEGMENTED    // segmented Sieve of Eratosthenes
+} Engine;
+
+//Structured output selected by --report
+typedef enum {
+    REPORT_NONE,
+    REPORT_JSON,
+    REPORT_CSV
+} ReportFormat;
+
+//Instruction set of the vector kernels, chosen by --isa
+typedef enum {
+    ISA_AUTO,           // widest one the CPU supports
+    ISA_SCALAR,
+    ISA_SSE42,
+    ISA_AVX2,
+    ISA_AVX512,         // AVX-512F + BW
+    NUM_ISAS
+} Isa;
+
+//Prime constellations counted by --tuples
+typedef enum {
+    TUPLES_NONE,
+    TUPLES_TWIN,        // (p, p+2)
+    TUPLES_TRIPLET,     // (p, p+2, p+6) and (p, p+4, p+6)
+    TUPLES_QUADRUPLET   // (p, p+2, p+6, p+8)
+} TupleKind;
+
+//Arithmetic functions evaluated by --arith
+typedef enum {
+    ARITH_NONE,
+    ARITH_PHI,          // Euler's totient
+    ARITH_MU,           // Moebius
+    ARITH_SIGMA,        // sum of divisors
+    ARITH_MERTENS       // running sum of mu
+} ArithFn;
+
+//Bits of Options.explicit_params: set on the command line, so the tuning profile leaves them alone
+#define EXPLICIT_THREADS  (1 << 0)
+#define EXPLICIT_SEGMENT  (1 << 1)
+#define EXPLICIT_PRESIEVE (1 << 2)
+#define EXPLICIT_CHUNK    (1 << 3)
+#define EXPLICIT_ENGINE   (1 << 4)
+
+//Everything parsed off the command line
+typedef struct {
+    long long max_value;
+    long long thread_count;
+    Engine engine;
+    Isa isa;                  // --isa: kernel variant, ISA_AUTO picks by CPU
+    int bench;                // --bench: repeat the run and report statistics
+    long long bench_warmup;   // untimed iterations before measuring
+    long long bench_reps;     // timed iterations
+    long long segment_size;   // numbers per segment for the segmented engine
+    int presieve_depth;       // how many small primes the pre-sieve pattern removes
+    long long chunk_size;     // numbers a threaded worker takes per lock acquisition
+    int tune;                 // --tune: search parameters and save them to the profile
+    int no_profile;           // --no-profile: ignore the saved tuning profile
+    int explicit_params;      // EXPLICIT_* bits
+    int counters;             // --counters: hardware performance counters per phase
+    int phases;               // --phases: wall-clock breakdown per phase
+    int thread_stats;         // --thread-stats: per-worker work and lock statistics
+    int memory;               // --memory: allocation, RSS and page-fault accounting
+    ReportFormat report;      // --report: one structured record instead of the text output
+    const char *trace_path;   // --trace: Chrome trace-event JSON output file
+    TupleKind tuples;         // --tuples: count prime k-tuples instead of primes
+    int list;                 // --list: print the tuples or function values as well
+    int gaps;                 // --gaps: prime gap histogram and maximal gaps
+    int goldbach;             // --goldbach: verify Goldbach's conjecture up to max_value
+    int sum;                  // --sum: sum of p^sum_power over primes up to max_value
+    int sum_power;            // --power: exponent for --sum, 0-2 (default 1)
+    int spf;                  // --spf: smallest-factor table, factor numbers from stdin
+    int factor;               // --factor: factor `number` (or stdin) with Pollard-Brent rho
+    int primality;            // --is-prime: Baillie-PSW test of `number` (or stdin)
+    int next_prime;           // --next: smallest prime above `number`
+    int prev_prime;           // --prev: largest prime below `number`
+    u128 number;              // 128-bit operand replacing max_value
+    int number_stdin;         // the operand was "-": one number per line from stdin
+    int bignum_test;          // --test: probable-prime test of numbers of any size
+    const char *number_text;  // --test operand: decimal digits, "-" for stdin or "bench"
+    long long random_primes;  // --random-primes: how many random primes to print
+    int random_range;         // --in was given
+    u128 random_lo;           // --in [lo,hi]: range the random primes are drawn from
+    u128 random_hi;
+    unsigned long long seed;  // --seed: start of the random streams (default 0)
+    long long ap_moduli;      // --ap=Q: prime counts per class for every modulus up to Q
+    long long ap_residue;     // --ap=a:q: count or list the primes = a mod q
+    long long ap_modulus;     // q of --ap=a:q, 0 when unused
+    ArithFn arith;            // --arith: evaluate a multiplicative function over [range_lo, max_value]
+    long long range_lo;       // --from: first number of the range (default 1)
+} Options;
+
+//Results of one run: the report's figures and the --counters per-number rates
+typedef struct {
+    long long total_primes;
+    double elapsed_ms;
+    long long numbers;        // numbers the run covered; main sets max_value, stdin modes their count
+} RunResult;
+
+#define DEFAULT_SEGMENT_SIZE (256LL * 1024)
+#define DEFAULT_PRESIEVE_DEPTH 6
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define SMALL_PRIME_MAX 313   // largest prime in the vectorized trial-division filter
+#define TRIAL_DIVISOR_LIMIT 65536 // is_prime's table of odd primes, enough for n below 2^32
+#define U128_DIGITS 39        // decimal digits of 2^128 - 1
+#define FACTOR_MAX 128        // prime factors of a number below 2^128, with repeats
+#define AP_MAX_MODULUS 10000  // largest Q for --ap=Q
+#define SUM_SQUARES_MAX 30000000000000LL // largest x for --sum --power=2; the sum of p^2 passes 2^128 near 3.15e13
+
+//Repeating pattern of numbers coprime to the first `depth` primes
+typedef struct {
+    unsigned char *pattern;
+    long long period;
+    int depth;
+    long long largest;        // largest prime folded into the pattern
+} PreSieve;
+
+//Smallest prime factor of every n <= limit coprime to 30, 0 for primes
+typedef struct {
+    unsigned int *spf;
+    long long entries;
+    long long limit;
+} SpfTable;
+
+//Montgomery form mod an odd n with R = 2^64; residues stay in [0, n)
+typedef struct {
+    unsigned long long n;
+    unsigned long long ninv;  // n^-1 mod 2^64
+    unsigned long long one;   // R mod n
+    unsigned long long r2;    // R^2 mod n
+} Mont64;
+
+//The same with R = 2^128, for any odd n < 2^128
+typedef struct {
+    u128 n;
+    u128 ninv;
+    u128 one;
+    u128 r2;
+} Mont128;
+
+//Called once per segment [lo, hi); index counts segments from the start of the range
+typedef void (*SegmentFn)(void *ctx, int thread_id, long long index, long long lo, long long hi);
+
+//Receives the segments' results in segment order, one call at a time
+typedef void (*OrderedFn)(void *ctx, void *item);
+
+//Segment results finished out of order and delivered in order (ordered.c)
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t advanced;  // signalled when next moves
+    void **items;             // results held, at index % window
+    unsigned char *ready;
+    long long window;         // how far past next a result may arrive
+    long long next;           // index of the next result to deliver
+    OrderedFn deliver;
+    void *ctx;
+} OrderedOutput;
+
+//Text a worker builds for one segment
+typedef struct {
+    char *text;
+    size_t len;
+    size_t cap;
+} TextBuf;
+
+//Stages of a run that timing and counters are attributed to
+typedef enum {
+    PHASE_PARSE,
+    PHASE_ALLOC,
+    PHASE_FIRST_TOUCH,  // faulting in the results pages
+    PHASE_BASE_SIEVE,   // base primes and the pre-sieve pattern
+    PHASE_SIEVE,
+    PHASE_COUNT,
+    PHASE_FORMAT,       // primes to decimal text
+    PHASE_WRITE,
+    NUM_PHASES
+} Phase;
+
+//Hardware events recorded by --counters
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_DTLB_MISSES,
+    NUM_COUNTERS
+} Counter;
+
+//Subsystems whose allocations --memory accounts for
+typedef enum {
+    MEM_RESULTS,        // the one-byte-per-number results array
+    MEM_BASE_PRIMES,    // base prime sieve and list
+    MEM_SEGMENTS,       // pre-sieve pattern stamped into each segment
+    MEM_OUTPUT,         // formatting buffers
+    MEM_THREADS,        // thread handles and worker state
+    NUM_MEM_KINDS
+} MemKind;
+
+#define STAT_BUCKETS 32
+
+//What one worker did; times are in ticks of tsc_now()
+typedef struct {
+    long long items;                   // numbers or segments taken off the shared counter
+    unsigned long long busy_ticks;     // lifetime minus time spent on the lock
+    unsigned long long wait_ticks;     // waiting to acquire the work lock
+    unsigned long long hold_ticks;     // holding the work lock
+    long long wait_hist[STAT_BUCKETS]; // bucket b counts waits under 2^(b+1) ns
+    long long hold_hist[STAT_BUCKETS];
+} WorkerStats;
+
+//Timer Declaration
+struct Timer {
+    struct timespec start;
+};
+
+void timer_start(struct Timer *my_timer);
+double get_time(const struct Timer *t);
+
+//pprimes.c
+int parse_integer_arguments(const char *input, long long *outValue);
+int is_prime(long long n);
+unsigned char *alloc_results(long long max_value);
+void free_results(unsigned char *arr, long long max_value);
+void first_touch(unsigned char *arr, size_t bytes);
+long long count_primes_range(const unsigned char *is_prime, long long lo, long long hi);
+long long count_primes(const unsigned char *is_prime, long long max_value);
+size_t format_primes(char *buf, size_t cap, const unsigned char *is_prime, long long *next, long long hi);
+void print_prime_list(FILE *out, const unsigned char *is_prime, long long lo, long long hi);
+void run_sequential(long long max_value, unsigned char *is_prime_arr);
+void run_threaded(long long max_value, long long thread_count, long long chunk, unsigned char *is_prime_arr);
+void run_engine(const Options *opts, unsigned char *is_prime_arr);
+const char *engine_label(const Options *opts);
+
+//options.c
+int parse_command_line(int argc, const char *argv[], Options *opts);
+
+//sieve.c
+long long isqrt_ll(long long n);
+long long *sieve_base_primes(long long limit, long long *count);
+void presieve_init(PreSieve *ps, int depth);
+void presieve_free(PreSieve *ps);
+void pattern_fill(const unsigned char *pattern, long long period, unsigned char *seg, long long lo, long long len);
+void presieve_fill(const PreSieve *ps, unsigned char *seg, long long lo, long long len);
+void cross_off_segment(unsigned char *seg, long long lo, long long len,
+                       const long long *primes, long long nprimes);
+void for_each_segment(long long lo, long long hi, long long segment_size, int nthreads,
+                      SegmentFn fn, void *ctx);
+void run_segmented(const Options *opts, unsigned char *is_prime_arr);
+
+//ordered.c
+void ordered_init(OrderedOutput *o, int nthreads, OrderedFn deliver, void *ctx);
+void ordered_free(OrderedOutput *o);
+void ordered_put(OrderedOutput *o, long long index, void *item);
+TextBuf *text_new(void);
+void text_reserve(TextBuf *t, size_t more);
+void ordered_write_text(void *ctx, void *item);
+
+//simd.c
+const char *isa_name(Isa isa);
+int parse_isa(const char *name, Isa *out);
+int isa_supported(Isa isa);
+int simd_init(Isa isa);
+Isa simd_isa(void);
+long long simd_count_nonzero(const unsigned char *p, long long len);
+long long simd_next_nonzero(const unsigned char *p, long long from, long long to);
+int simd_small_factor(unsigned int n);
+void simd_add_bytes(unsigned short *lanes, const unsigned char *p, long long len);
+
+//ktuple.c
+const char *tuple_kind_name(TupleKind kind);
+int parse_tuple_kind(const char *name, TupleKind *out);
+int run_tuples(const Options *opts, RunResult *result);
+
+//gaps.c
+int run_gaps(const Options *opts, RunResult *result);
+
+//goldbach.c
+int run_goldbach(const Options *opts, RunResult *result);
+
+//primesum.c
+unsigned __int128 prime_power_sum(long long x, int k, int nthreads);
+int run_prime_sum(const Options *opts, RunResult *result);
+
+//spf.c
+void spf_build(SpfTable *t, long long limit);
+void spf_free(SpfTable *t);
+int spf_factor(const SpfTable *t, long long n, long long *primes, int *exponents);
+int run_spf(const Options *opts, RunResult *result);
+
+//arith.c
+const char *arith_name(ArithFn fn);
+int parse_arith(const char *name, ArithFn *out);
+int run_arith(const Options *opts, RunResult *result);
+
+//progression.c
+int run_progressions(const Options *opts, RunResult *result);
+
+//u128.c
+char *u128_format(unsigned __int128 v, char *buf);
+int parse_u128(const char *input, unsigned __int128 *out);
+
+//primality.c
+void mont64_init(Mont64 *m, unsigned long long n);
+void mont128_init(Mont128 *m, u128 n);
+unsigned long long mont64_pow(const Mont64 *m, unsigned long long base, unsigned long long exp);
+u128 mont128_pow(const Mont128 *m, u128 base, u128 exp);
+int is_prime_u64(unsigned long long n);
+int is_prime_u128(u128 n);
+int run_primality(const Options *opts, RunResult *result);
+
+//nextprime.c
+int run_next_prime(const Options *opts, RunResult *result);
+
+//randprime.c
+int run_random_primes(const Options *opts, RunResult *result);
+
+//bignum.c
+int bn_is_probable_prime(const unsigned long long *n, int k);
+int bn_parse_decimal(const char *input, unsigned long long **n, const char **digits, int *ndigits);
+int run_bignum_test(const Options *opts, RunResult *result);
+
+//factor.c
+int factor_u128(u128 n, u128 *factors);
+int run_factor(const Options *opts, RunResult *result);
+
+//phases.c
+const char *phase_name(Phase phase);
+unsigned long long tsc_now(void);
+void tsc_calibrate(void);
+void phases_init(void);
+double tsc_to_ns(unsigned long long ticks);
+void phase_add(Phase phase, unsigned long long start, unsigned long long end);
+void phase_begin(Phase phase);
+void phase_end(Phase phase);
+double phase_ms(Phase phase);
+void phases_report(void);
+
+//counters.c
+void counters_init(void);
+int counters_enabled(void);
+void counters_phase_begin(Phase phase);
+void counters_phase_end(Phase phase);
+void counters_thread_begin(void);
+void counters_thread_end(void);
+double counter_value(Phase phase, Counter c);
+const char *counter_name(Counter c);
+void counters_report(long long numbers);
+
+//threadstats.c
+void thread_stats_init(void);
+int thread_stats_enabled(void);
+void thread_stats_prepare(int nthreads);
+WorkerStats *thread_stats_worker(int thread_id);
+void thread_stats_lock(WorkerStats *s, unsigned long long wait_ticks, unsigned long long hold_ticks);
+void thread_stats_report(void);
+
+//memory.c
+const char *mem_name(MemKind kind);
+void mem_track(MemKind kind, long long bytes);
+long long mem_peak_bytes(MemKind kind);
+long long mem_total_peak_bytes(void);
+long long peak_rss_bytes(void);
+void page_faults(long long *minor, long long *major);
+void memory_report(void);
+
+//report.c
+void write_report(FILE *out, const Options *opts, const RunResult *r);
+
+//trace.c
+void trace_init(const char *path);
+int trace_enabled(void);
+void trace_event(const char *name, unsigned long long start, unsigned long long end, long long arg);
+void trace_thread_end(void);
+void trace_write(void);
+
+//bench.c
+double sample_median(double *samples, long long n);
+int bench_runs(const Options *opts, unsigned char *is_prime_arr, long long warmup, long long reps,
+               double *samples, long long *primes);
+int run_bench(const Options *opts, RunResult *result);
+
+//tune.c
+void tune_apply_profile(Options *opts);
+int run_tune(Options *opts);
+
+//Montgomery products, inline because the rho and primality loops call little else
+static inline unsigned long long mont64_reduce(const Mont64 *m, u128 t) {
+    unsigned long long q = (unsigned long long)t * m->ninv;
+    unsigned long long h = (unsigned long long)(((u128)q * m->n) >> 64);
+    unsigned long long th = (unsigned long long)(t >> 64);
+    //the low halves of t and q*n cancel exactly, so only the high halves subtract
+    return th >= h ? th - h : th - h + m->n;
+}
+
+static inline unsigned long long mont64_mul(const Mont64 *m, unsigned long long a, unsigned long long b) {
+    return mont64_reduce(m, (u128)a * b);
+}
+
+static inline unsigned long long mont64_to(const Mont64 *m, unsigned long long a) {
+    return mont64_mul(m, a % m->n, m->r2);
+}
+
+static inline unsigned long long mont64_from(const Mont64 *m, unsigned long long a) {
+    return mont64_reduce(m, a);
+}
+
+static inline unsigned long long mont64_add(const Mont64 *m, unsigned long long a, unsigned long long b) {
+    unsigned long long s = a + b;
+    return (s < a || s >= m->n) ? s - m->n : s;
+}
+
+static inline unsigned long long mont64_sub(const Mont64 *m, unsigned long long a, unsigned long long b) {
+    return a >= b ? a - b : a - b + m->n;
+}
+
+//Trailing zero bits of x != 0
+static inline int ctz_u128(u128 x) {
+    unsigned long long lo = (unsigned long long)x;
+    return lo ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((unsigned long long)(x >> 64));
+}
+
+//Full 256-bit product of a and b as hi:lo
+static inline void u128_mul_wide(u128 a, u128 b, u128 *hi, u128 *lo) {
+    unsigned long long a0 = (unsigned long long)a, a1 = (unsigned long long)(a >> 64);
+    unsigned long long b0 = (unsigned long long)b, b1 = (unsigned long long)(b >> 64);
+    u128 p00 = (u128)a0 * b0, p01 = (u128)a0 * b1, p10 = (u128)a1 * b0, p11 = (u128)a1 * b1;
+    u128 mid = (p00 >> 64) + (unsigned long long)p01 + (unsigned long long)p10;
+    *lo = (u128)(unsigned long long)p00 | (mid << 64);
+    *hi = p11 + (p01 >> 64) + (p10 >> 64) + (mid >> 64);
+}
+
+static inline u128 mont128_mul(const Mont128 *m, u128 a, u128 b) {
+    u128 th, tl, h, l;
+    u128_mul_wide(a, b, &th, &tl);
+    u128_mul_wide(tl * m->ninv, m->n, &h, &l);
+    return th >= h ? th - h : th - h + m->n;
+}
+
+static inline u128 mont128_to(const Mont128 *m, u128 a) {
+    return mont128_mul(m, a % m->n, m->r2);
+}
+
+static inline u128 mont128_from(const Mont128 *m, u128 a) {
+    return mont128_mul(m, a, 1);
+}
+
+static inline u128 mont128_add(const Mont128 *m, u128 a, u128 b) {
+    u128 s = a + b;
+    return (s < a || s >= m->n) ? s - m->n : s;
+}
+
+static inline u128 mont128_sub(const Mont128 *m, u128 a, u128 b) {
+    return a >= b ? a - b : a - b + m->n;
+}
 
 #endif /* pprimes_h */
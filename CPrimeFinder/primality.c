@@ -0,0 +1,313 @@
+//
+//  primality.c
+//  CPrimeFinder
+//
+//  Primality of single 64- and 128-bit numbers, for the modes that cannot
+//  sieve up to them. Everything runs in Montgomery form, so a modular product
+//  is two or three hardware multiplies and no division. Below 2^64 the strong
+//  probable-prime test to the seven bases of Jim Sinclair is exact. Above it
+//  the test is Baillie-PSW: a strong probable-prime test to base 2 followed by
+//  a strong Lucas test with Selfridge's parameters. The two fail on unrelated
+//  composites, no number passing both is known, and together they cost about
+//  three modular exponentiations.
+//
+//  --is-prime tests one number, or every number on stdin in batches that the
+//  segment workers split between them.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "pprimes.h"
+
+static const unsigned small_primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+#define NUM_SMALL_PRIMES (int)(sizeof(small_primes) / sizeof(small_primes[0]))
+//product of the small primes up to 47, so one 128-bit remainder serves all of them
+#define PRIMORIAL_47 614889782588491410ULL
+
+#define PRIMALITY_LINE 128
+#define PRIMALITY_BATCH 65536   // numbers read from stdin per round of the workers
+#define PRIMALITY_SLICE 1024    // numbers per worker task
+#define PRIMALITY_LINE_MAX (U128_DIGITS + 12)
+
+//every composite below 2^64 fails the strong test for one of these bases
+static const unsigned long long sinclair_bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+
+void mont64_init(Mont64 *m, unsigned long long n) {
+    //Newton's iteration doubles the correct low bits; n is its own inverse mod 8
+    unsigned long long inv = n;
+    for (int i = 0; i < 5; ++i) inv *= 2 - n * inv;
+    m->n = n;
+    m->ninv = inv;
+    m->one = (0 - n) % n;
+    m->r2 = (unsigned long long)(((u128)m->one * m->one) % n);
+}
+
+void mont128_init(Mont128 *m, u128 n) {
+    u128 inv = n;
+    for (int i = 0; i < 6; ++i) inv *= 2 - n * inv;
+    m->n = n;
+    m->ninv = inv;
+    m->one = (0 - n) % n;
+    //R^2 mod n by doubling R mod n 128 times, since the product does not fit
+    u128 r2 = m->one;
+    for (int i = 0; i < 128; ++i) r2 = mont128_add(m, r2, r2);
+    m->r2 = r2;
+}
+
+//base^exp with base in Montgomery form; the result is in Montgomery form too
+unsigned long long mont64_pow(const Mont64 *m, unsigned long long base, unsigned long long exp) {
+    unsigned long long result = m->one;
+    while (exp) {
+        if (exp & 1) result = mont64_mul(m, result, base);
+        base = mont64_mul(m, base, base);
+        exp >>= 1;
+    }
+    return result;
+}
+
+u128 mont128_pow(const Mont128 *m, u128 base, u128 exp) {
+    u128 result = m->one;
+    while (exp) {
+        if (exp & 1) result = mont128_mul(m, result, base);
+        base = mont128_mul(m, base, base);
+        exp >>= 1;
+    }
+    return result;
+}
+
+//Strong probable-prime test of odd n to base a (in [1, n)), with n - 1 = d * 2^s
+static int strong_probable_prime64(const Mont64 *m, unsigned long long a, unsigned long long d, int s) {
+    unsigned long long minus_one = m->n - m->one;
+    unsigned long long x = mont64_pow(m, mont64_to(m, a), d);
+    if (x == m->one || x == minus_one) return 1;
+    for (int i = 1; i < s; ++i) {
+        x = mont64_mul(m, x, x);
+        if (x == minus_one) return 1;
+    }
+    return 0;
+}
+
+static int strong_probable_prime128(const Mont128 *m, u128 a, u128 d, int s) {
+    u128 minus_one = m->n - m->one;
+    u128 x = mont128_pow(m, mont128_to(m, a), d);
+    if (x == m->one || x == minus_one) return 1;
+    for (int i = 1; i < s; ++i) {
+        x = mont128_mul(m, x, x);
+        if (x == minus_one) return 1;
+    }
+    return 0;
+}
+
+//Exact for every n < 2^64
+int is_prime_u64(unsigned long long n) {
+    for (int i = 0; i < NUM_SMALL_PRIMES; ++i) {
+        if (n % small_primes[i] == 0) return n == small_primes[i];
+    }
+    if (n < 59 * 59) return n > 1;
+    Mont64 m;
+    mont64_init(&m, n);
+    unsigned long long d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+    for (int i = 0; i < (int)(sizeof(sinclair_bases) / sizeof(sinclair_bases[0])); ++i) {
+        unsigned long long a = sinclair_bases[i] % n;
+        if (a == 0) continue;
+        if (!strong_probable_prime64(&m, a, d, s)) return 0;
+    }
+    return 1;
+}
+
+//Jacobi symbol (a / n) for odd n
+static int jacobi_u128(u128 a, u128 n) {
+    int t = 1;
+    a %= n;
+    while (a) {
+        int z = ctz_u128(a);
+        a >>= z;
+        if ((z & 1) && ((n & 7) == 3 || (n & 7) == 5)) t = -t;
+        if ((a & 3) == 3 && (n & 3) == 3) t = -t;
+        u128 r = n % a;
+        n = a;
+        a = r;
+    }
+    return n == 1 ? t : 0;
+}
+
+static int is_square_u128(u128 n) {
+    u128 r = (u128)sqrtl((long double)n);
+    while (r * r > n) r--;
+    while (r < ~0ULL && (r + 1) * (r + 1) <= n) r++;
+    return r * r == n;
+}
+
+//x / 2 mod n, which Montgomery form leaves alone
+static inline u128 mont128_half(const Mont128 *m, u128 x) {
+    return (x & 1) ? (x >> 1) + (m->n >> 1) + 1 : x >> 1;
+}
+
+//n mod m->n of a small signed n, in Montgomery form
+static u128 mont128_small(const Mont128 *m, long long n) {
+    return mont128_to(m, n >= 0 ? (u128)n : m->n - (u128)(-n));
+}
+
+//Strong Lucas probable-prime test of odd n > 2^64 with no small factor, P = 1 and
+//D the first of 5, -7, 9, -11, ... with (D / n) = -1
+static int strong_lucas128(const Mont128 *m) {
+    u128 n = m->n;
+    long long D = 5;
+    for (int tries = 0;; ++tries) {
+        int j = jacobi_u128(D >= 0 ? (u128)D : n - (u128)(-D), n);
+        if (j == -1) break;
+        //n is far larger than |D|, so a common factor makes it composite
+        if (j == 0) return 0;
+        //no D works for a square, so rule them out once the first few fail
+        if (tries == 8 && is_square_u128(n)) return 0;
+        D = D > 0 ? -(D + 2) : -D + 2;
+    }
+    u128 dm = mont128_small(m, D);
+    u128 qm = mont128_small(m, (1 - D) / 4);
+
+    //n + 1 = d * 2^s; n < 2^128 - 1 since 3 divides that
+    u128 d = n + 1;
+    int s = ctz_u128(d);
+    d >>= s;
+    int bits = 128 - ((d >> 64) ? __builtin_clzll((unsigned long long)(d >> 64))
+                                : 64 + __builtin_clzll((unsigned long long)d));
+    //U_k, V_k and Q^k from k = 1 along the bits of d
+    u128 u = m->one, v = m->one, qk = qm;
+    for (int b = bits - 2; b >= 0; --b) {
+        u = mont128_mul(m, u, v);
+        v = mont128_sub(m, mont128_mul(m, v, v), mont128_add(m, qk, qk));
+        qk = mont128_mul(m, qk, qk);
+        if ((d >> b) & 1) {
+            u128 u1 = mont128_half(m, mont128_add(m, u, v));
+            v = mont128_half(m, mont128_add(m, mont128_mul(m, dm, u), v));
+            u = u1;
+            qk = mont128_mul(m, qk, qm);
+        }
+    }
+    if (u == 0 || v == 0) return 1;
+    for (int r = 1; r < s; ++r) {
+        v = mont128_sub(m, mont128_mul(m, v, v), mont128_add(m, qk, qk));
+        if (v == 0) return 1;
+        qk = mont128_mul(m, qk, qk);
+    }
+    return 0;
+}
+
+//Exact below 2^64, Baillie-PSW above
+int is_prime_u128(u128 n) {
+    if ((n >> 64) == 0) return is_prime_u64((unsigned long long)n);
+    unsigned long long r = (unsigned long long)(n % PRIMORIAL_47);
+    for (int i = 0; small_primes[i] <= 47; ++i) {
+        if (r % small_primes[i] == 0) return 0;
+    }
+    Mont128 m;
+    mont128_init(&m, n);
+    u128 d = n - 1;
+    int s = ctz_u128(d);
+    d >>= s;
+    if (!strong_probable_prime128(&m, 2, d, s)) return 0;
+    return strong_lucas128(&m);
+}
+
+typedef struct {
+    const u128 *numbers;
+    char *text;               // PRIMALITY_SLICE lines per slice
+    size_t *text_len;         // per slice
+    long long *primes;        // per slice
+} PrimalityBatch;
+
+//Tests numbers[lo, hi) and formats their lines into the slice's text
+static void primality_slice_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    (void)thread_id;
+    PrimalityBatch *b = (PrimalityBatch *)arg;
+    char *out = b->text + (size_t)index * PRIMALITY_SLICE * PRIMALITY_LINE_MAX;
+    size_t len = 0;
+    long long primes = 0;
+    for (long long i = lo; i < hi; ++i) {
+        int prime = is_prime_u128(b->numbers[i]);
+        primes += prime;
+        u128_format(b->numbers[i], out + len);
+        len += strlen(out + len);
+        len += (size_t)sprintf(out + len, prime ? ": prime\n" : ": not prime\n");
+    }
+    b->text_len[index] = len;
+    b->primes[index] = primes;
+}
+
+//Tests and prints numbers[0, count) on nthreads workers; returns how many are prime
+static long long test_batch(PrimalityBatch *b, long long count, int nthreads) {
+    long long slices = (count + PRIMALITY_SLICE - 1) / PRIMALITY_SLICE;
+    long long primes = 0;
+    for_each_segment(0, count, PRIMALITY_SLICE, nthreads, primality_slice_fn, b);
+    for (long long k = 0; k < slices; ++k) {
+        fwrite(b->text + (size_t)k * PRIMALITY_SLICE * PRIMALITY_LINE_MAX, 1, b->text_len[k], stdout);
+        primes += b->primes[k];
+    }
+    return primes;
+}
+
+//Tests opts->number, or every number on stdin
+int run_primality(const Options *opts, RunResult *result) {
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    int rc = EXIT_SUCCESS;
+    long long slices = PRIMALITY_BATCH / PRIMALITY_SLICE;
+    u128 *numbers = (u128 *)malloc(sizeof(u128) * PRIMALITY_BATCH);
+    char *text = (char *)malloc((size_t)PRIMALITY_BATCH * PRIMALITY_LINE_MAX);
+    size_t *text_len = (size_t *)malloc(sizeof(size_t) * (size_t)slices);
+    long long *slice_primes = (long long *)malloc(sizeof(long long) * (size_t)slices);
+    if (!numbers || !text || !text_len || !slice_primes) {
+        fprintf(stderr, "Error: failed to allocate primality buffers\n");
+        exit(EXIT_FAILURE);
+    }
+    long long buffer_bytes = (long long)(sizeof(u128) * PRIMALITY_BATCH + sizeof(size_t) * (size_t)slices
+                                         + sizeof(long long) * (size_t)slices);
+    mem_track(MEM_RESULTS, buffer_bytes);
+    mem_track(MEM_OUTPUT, (long long)PRIMALITY_BATCH * PRIMALITY_LINE_MAX);
+    PrimalityBatch batch = { numbers, text, text_len, slice_primes };
+    int nthreads = (int)opts->thread_count;
+
+    long long tested = 0, primes = 0;
+    phase_begin(PHASE_SIEVE);
+    if (!opts->number_stdin) {
+        numbers[0] = opts->number;
+        primes = test_batch(&batch, 1, 1);
+        tested = 1;
+    } else {
+        char line[PRIMALITY_LINE];
+        long long count = 0;
+        int more = 1;
+        while (more) {
+            more = fgets(line, sizeof(line), stdin) != NULL;
+            if (more) {
+                if (line[strspn(line, " \t\r\n")] == '\0') continue;
+                if (!parse_u128(line, &numbers[count])) {
+                    line[strcspn(line, "\r\n")] = '\0';
+                    fprintf(stderr, "Error: '%s' is not an integer in [0, 2^128).\n", line);
+                    rc = EXIT_FAILURE;
+                    continue;
+                }
+                if (++count < PRIMALITY_BATCH) continue;
+            }
+            primes += test_batch(&batch, count, nthreads);
+            tested += count;
+            count = 0;
+        }
+    }
+    phase_end(PHASE_SIEVE);
+    printf("[is-prime] tested: %lld, prime: %lld in %.3f ms\n", tested, primes, get_time(&my_timer));
+
+    free(numbers);
+    free(text);
+    free(text_len);
+    free(slice_primes);
+    mem_track(MEM_RESULTS, -buffer_bytes);
+    mem_track(MEM_OUTPUT, -(long long)PRIMALITY_BATCH * PRIMALITY_LINE_MAX);
+    result->numbers = tested;
+    return rc;
+}
@@ -0,0 +1,244 @@
+//
+//  primesum.c
+//  CPrimeFinder
+//
+//  Sum of p^k over primes p <= x (--sum, --power=0|1|2) with the Lucy_Hedgehog
+//  dynamic program in O(x^(3/4)) time and O(sqrt(x)) memory. S(v) starts as
+//  the sum of n^k over 2 <= n <= v for every v = floor(x / i); each prime
+//  p <= sqrt(x) then removes the numbers whose smallest factor is p:
+//
+//      S(v) -= p^k * (S(v / p) - S(p - 1))    for v >= p^2
+//
+//  Values are unsigned 128-bit and wrap, which is harmless as long as the
+//  final sum fits: it does for k = 0 and 1 at any x, and for k = 2 up to
+//  SUM_SQUARES_MAX, which the command line enforces. Large rounds run on all threads in two passes (compute
+//  into a scratch copy, then store) separated by barriers, since one round
+//  reads entries the same round overwrites; small rounds run in place.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+//rounds updating fewer entries than this are not worth waking the threads for
+#define SUM_PARALLEL_MIN (1LL << 15)
+
+//Reusable barrier; pthread_barrier_t is missing on macOS
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+    int waiting;
+    unsigned long long generation;
+} Barrier;
+
+static void barrier_init(Barrier *b, int count) {
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->cond, NULL);
+    b->count = count;
+    b->waiting = 0;
+    b->generation = 0;
+}
+
+static void barrier_destroy(Barrier *b) {
+    pthread_cond_destroy(&b->cond);
+    pthread_mutex_destroy(&b->lock);
+}
+
+static void barrier_wait(Barrier *b) {
+    pthread_mutex_lock(&b->lock);
+    unsigned long long generation = b->generation;
+    if (++b->waiting == b->count) {
+        b->waiting = 0;
+        b->generation++;
+        pthread_cond_broadcast(&b->cond);
+    } else {
+        while (generation == b->generation) pthread_cond_wait(&b->cond, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+typedef struct {
+    long long x;
+    long long r;              // isqrt(x)
+    u128 *lo;                 // lo[v] = S(v) for v <= r
+    u128 *hi;                 // hi[i] = S(x / i) for i <= r
+    u128 *lo_next;            // scratch for the two-pass rounds
+    u128 *hi_next;
+    int nthreads;
+    Barrier barrier;
+    //the current round, published before the start barrier
+    long long p;
+    u128 pk;
+    long long hi_count;       // hi[1..hi_count] change
+    int done;
+} SumState;
+
+typedef struct {
+    SumState *state;
+    int thread_id;
+} SumWorker;
+
+//Sum of n^k for 2 <= n <= v, mod 2^128; factors are divided before multiplying
+static u128 initial_sum(long long v, int k) {
+    if (v < 2) return 0;
+    u128 a = (u128)v, b = (u128)v + 1;
+    if (k == 0) return a - 1;
+    if (a % 2 == 0) a /= 2; else b /= 2;
+    if (k == 1) return a * b - 1;
+    u128 c = 2 * (u128)v + 1;
+    if (a % 3 == 0) a /= 3; else if (b % 3 == 0) b /= 3; else c /= 3;
+    return a * b * c - 1;
+}
+
+//New S value of hi[i] / lo[v] in the current round, read from the current arrays
+static inline u128 updated_hi(const SumState *s, long long i, u128 sp) {
+    long long ip = i * s->p;
+    u128 quotient = (ip <= s->r) ? s->hi[ip] : s->lo[s->x / ip];
+    return s->hi[i] - s->pk * (quotient - sp);
+}
+
+static inline u128 updated_lo(const SumState *s, long long v, u128 sp) {
+    return s->lo[v] - s->pk * (s->lo[v / s->p] - sp);
+}
+
+//This thread's share of the round: compute into the scratch arrays, wait, store
+static void parallel_round_share(SumState *s, int thread_id) {
+    long long p2 = s->p * s->p;
+    u128 sp = s->lo[s->p - 1];
+    long long hi_per = (s->hi_count + s->nthreads - 1) / s->nthreads;
+    long long hi_from = 1 + thread_id * hi_per;
+    long long hi_to = hi_from + hi_per - 1 < s->hi_count ? hi_from + hi_per - 1 : s->hi_count;
+    long long lo_count = s->r >= p2 ? s->r - p2 + 1 : 0;
+    long long lo_per = (lo_count + s->nthreads - 1) / s->nthreads;
+    long long lo_from = p2 + thread_id * lo_per;
+    long long lo_to = lo_from + lo_per - 1 < s->r ? lo_from + lo_per - 1 : s->r;
+
+    for (long long i = hi_from; i <= hi_to; ++i) s->hi_next[i] = updated_hi(s, i, sp);
+    for (long long v = lo_from; v <= lo_to; ++v) s->lo_next[v] = updated_lo(s, v, sp);
+    barrier_wait(&s->barrier);
+    for (long long i = hi_from; i <= hi_to; ++i) s->hi[i] = s->hi_next[i];
+    for (long long v = lo_from; v <= lo_to; ++v) s->lo[v] = s->lo_next[v];
+    barrier_wait(&s->barrier);
+}
+
+static void *sum_thread_function(void *arg) {
+    SumWorker *worker = (SumWorker *)arg;
+    SumState *s = worker->state;
+    counters_thread_begin();
+    for (;;) {
+        barrier_wait(&s->barrier);
+        if (s->done) break;
+        parallel_round_share(s, worker->thread_id);
+    }
+    counters_thread_end();
+    trace_thread_end();
+    return NULL;
+}
+
+//Sum of p^k over primes p <= x, mod 2^128
+unsigned __int128 prime_power_sum(long long x, int k, int nthreads) {
+    if (x < 2) return 0;
+    SumState s;
+    s.x = x;
+    s.r = isqrt_ll(x);
+    s.nthreads = nthreads < 1 ? 1 : nthreads;
+    s.done = 0;
+    size_t bytes = sizeof(u128) * (size_t)(s.r + 1);
+    s.lo = (u128 *)malloc(bytes);
+    s.hi = (u128 *)malloc(bytes);
+    s.lo_next = s.nthreads > 1 ? (u128 *)malloc(bytes) : NULL;
+    s.hi_next = s.nthreads > 1 ? (u128 *)malloc(bytes) : NULL;
+    if (!s.lo || !s.hi || (s.nthreads > 1 && (!s.lo_next || !s.hi_next))) {
+        fprintf(stderr, "Error: failed to allocate the prime sum tables\n");
+        exit(EXIT_FAILURE);
+    }
+    long long table_bytes = (long long)bytes * (s.nthreads > 1 ? 4 : 2);
+    mem_track(MEM_RESULTS, table_bytes);
+
+    phase_begin(PHASE_ALLOC);
+    for (long long v = 0; v <= s.r; ++v) s.lo[v] = initial_sum(v, k);
+    s.hi[0] = 0;
+    for (long long i = 1; i <= s.r; ++i) s.hi[i] = initial_sum(x / i, k);
+    phase_end(PHASE_ALLOC);
+
+    pthread_t *threads = NULL;
+    SumWorker *workers = NULL;
+    if (s.nthreads > 1) {
+        barrier_init(&s.barrier, s.nthreads);
+        threads = (pthread_t *)malloc(sizeof(pthread_t) * (size_t)s.nthreads);
+        workers = (SumWorker *)malloc(sizeof(SumWorker) * (size_t)s.nthreads);
+        if (!threads || !workers) {
+            fprintf(stderr, "Error: failed to allocate thread handles\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int t = 1; t < s.nthreads; ++t) {
+            workers[t].state = &s;
+            workers[t].thread_id = t;
+            int rc = pthread_create(&threads[t], NULL, sum_thread_function, &workers[t]);
+            if (rc != 0) {
+                fprintf(stderr, "Error: pthread_create failed (%d)\n", rc);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    phase_begin(PHASE_SIEVE);
+    for (long long p = 2; p <= s.r; ++p) {
+        if (s.lo[p] == s.lo[p - 1]) continue;  // not prime: S did not grow at p
+        long long p2 = p * p;
+        long long hi_count = x / p2 < s.r ? x / p2 : s.r;
+        long long lo_count = s.r >= p2 ? s.r - p2 + 1 : 0;
+        u128 pk = 1;
+        for (int e = 0; e < k; ++e) pk *= (u128)p;
+        s.p = p;
+        s.pk = pk;
+        s.hi_count = hi_count;
+
+        if (s.nthreads > 1 && hi_count + lo_count >= SUM_PARALLEL_MIN) {
+            unsigned long long t0 = tsc_now();
+            barrier_wait(&s.barrier);
+            parallel_round_share(&s, 0);
+            trace_event("round", t0, tsc_now(), p);
+            continue;
+        }
+        //in place from the largest v down, so every S(v / p) read is still last round's
+        u128 sp = s.lo[p - 1];
+        for (long long i = 1; i <= hi_count; ++i) s.hi[i] = updated_hi(&s, i, sp);
+        for (long long v = s.r; v >= p2; --v) s.lo[v] = updated_lo(&s, v, sp);
+    }
+    phase_end(PHASE_SIEVE);
+
+    if (s.nthreads > 1) {
+        s.done = 1;
+        barrier_wait(&s.barrier);
+        for (int t = 1; t < s.nthreads; ++t) pthread_join(threads[t], NULL);
+        barrier_destroy(&s.barrier);
+        free(workers);
+        free(threads);
+    }
+
+    u128 result = s.hi[1];
+    free(s.lo);
+    free(s.hi);
+    free(s.lo_next);
+    free(s.hi_next);
+    mem_track(MEM_RESULTS, -table_bytes);
+    return result;
+}
+
+//Prints the sum of p^power over primes p <= max_value
+int run_prime_sum(const Options *opts, RunResult *result) {
+    (void)result;
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    unsigned __int128 sum = prime_power_sum(opts->max_value, opts->sum_power, (int)opts->thread_count);
+    double ms = get_time(&my_timer);
+
+    char digits[U128_DIGITS + 1];
+    printf("[sum] sum of p^%d for p <= %lld: %s\n", opts->sum_power, opts->max_value, u128_format(sum, digits));
+    printf("[sum] elapsed: %.3f ms\n", ms);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+//
+//  progression.c
+//  CPrimeFinder
+//
+//  Primes in arithmetic progressions (--ap). --ap=Q counts the primes up to
+//  max_value in every class a mod q for all q <= Q in one segmented pass;
+//  --ap=a:q counts (and with --list prints) the primes = a mod q alone.
+//
+//  Only the moduli m in (Q/2, Q] are counted directly: every smaller q divides
+//  one of them, and its classes are sums of that modulus's classes. For each
+//  such m a segment is read as rows of m bytes and the rows are added into
+//  16-bit lanes with the simd_add_bytes kernel, so lane j ends up counting the
+//  primes at offsets = j mod m. That is one vector add per 16-32 numbers and
+//  modulus, with no division and no scattered counter updates per prime.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+//rows added into the 16-bit lanes before they are flushed, so they never overflow
+#define AP_ROW_FLUSH 65535
+//small moduli take several periods per row, so each kernel call adds at least this many bytes
+#define AP_MIN_ROW 256
+
+typedef struct {
+    unsigned char *seg;
+    unsigned short *lanes;    // one per offset in a row of the modulus being counted
+    long long *counts;        // classes of every modulus in (Q/2, Q], at ApContext.offsets
+    long long matched;        // primes in the single class
+} ApWorker;
+
+typedef struct {
+    const PreSieve *presieve;
+    const long long *primes;  // odd base primes past the pre-sieve pattern
+    long long nprimes;
+    long long max_modulus;    // Q, or 0 for a single class
+    long long first_top;      // smallest modulus counted directly
+    long long *offsets;       // offsets[m]: first class of modulus m in ApWorker.counts
+    long long residue;        // the single class
+    long long modulus;
+    ApWorker *workers;
+    int list;
+    OrderedOutput output;     // --list text, printed in segment order
+} ApContext;
+
+static long long gcd_ll(long long a, long long b) {
+    while (b) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+//Adds the width lanes into the classes of modulus m; lane 0 stands for a number = first mod m
+static void flush_lanes(unsigned short *lanes, long long width, long long m, long long first, long long *classes) {
+    long long r = first;
+    for (long long j = 0; j < width; ++j) {
+        classes[r] += lanes[j];
+        if (++r == m) r = 0;
+    }
+    memset(lanes, 0, sizeof(unsigned short) * (size_t)width);
+}
+
+//Counts the primes of seg = [lo, lo + len) in each class of modulus m
+static void count_classes(const unsigned char *seg, long long lo, long long len, long long m,
+                          unsigned short *lanes, long long *classes) {
+    long long width = m * ((AP_MIN_ROW + m - 1) / m);
+    long long first = lo % m;
+    long long start = 0;
+    long long rows = 0;
+    memset(lanes, 0, sizeof(unsigned short) * (size_t)width);
+    for (; start + width <= len; start += width) {
+        simd_add_bytes(lanes, seg + start, width);
+        if (++rows == AP_ROW_FLUSH) {
+            flush_lanes(lanes, width, m, first, classes);
+            rows = 0;
+        }
+    }
+    simd_add_bytes(lanes, seg + start, len - start);
+    flush_lanes(lanes, width, m, first, classes);
+}
+
+//Appends " p" to the growing text buffer
+static void append_prime(TextBuf *out, long long p) {
+    text_reserve(out, 22);
+    out->len += (size_t)sprintf(out->text + out->len, " %lld", p);
+}
+
+static void ap_segment_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    ApContext *ctx = (ApContext *)arg;
+    ApWorker *w = &ctx->workers[thread_id];
+    long long len = hi - lo;
+    presieve_fill(ctx->presieve, w->seg, lo, len);
+    cross_off_segment(w->seg, lo, len, ctx->primes, ctx->nprimes);
+
+    if (ctx->max_modulus) {
+        for (long long m = ctx->first_top; m <= ctx->max_modulus; ++m) {
+            count_classes(w->seg, lo, len, m, w->lanes, w->counts + ctx->offsets[m]);
+        }
+        return;
+    }
+
+    //one class: step through it directly
+    long long q = ctx->modulus;
+    long long i = ((ctx->residue - lo) % q + q) % q;
+    TextBuf *out = ctx->list ? text_new() : NULL;
+    for (; i < len; i += q) {
+        if (!w->seg[i]) continue;
+        w->matched++;
+        if (out) append_prime(out, lo + i);
+    }
+    if (out) ordered_put(&ctx->output, index, out);
+}
+
+//Prints the classes coprime to each q <= Q, folded from the moduli counted directly
+static void print_class_counts(const ApContext *ctx, const long long *counts) {
+    long long Q = ctx->max_modulus;
+    long long *classes = (long long *)malloc(sizeof(long long) * (size_t)Q);
+    if (!classes) {
+        fprintf(stderr, "Error: failed to allocate progression classes\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long long q = 1; q <= Q; ++q) {
+        long long m = (Q / q) * q;
+        const long long *top = counts + ctx->offsets[m];
+        memset(classes, 0, sizeof(long long) * (size_t)q);
+        for (long long b = 0; b < m; ++b) classes[b % q] += top[b];
+        if (q == 1) printf("[ap] total primes: %lld\n", classes[0]);
+        printf("[ap] mod %lld:", q);
+        for (long long a = 0; a < q; ++a) {
+            if (gcd_ll(a, q) == 1) printf(" %lld:%lld", a, classes[a]);
+        }
+        printf("\n");
+    }
+    free(classes);
+}
+
+//Counts the primes up to max_value by residue class, in one pass
+int run_progressions(const Options *opts, RunResult *result) {
+    (void)result;
+    struct Timer my_timer;
+    timer_start(&my_timer);
+
+    phase_begin(PHASE_BASE_SIEVE);
+    PreSieve presieve;
+    presieve_init(&presieve, opts->presieve_depth);
+    long long nprimes = 0;
+    long long *primes = sieve_base_primes(isqrt_ll(opts->max_value), &nprimes);
+    long long skip = 0;
+    while (skip < nprimes && primes[skip] <= presieve.largest) skip++;
+    phase_end(PHASE_BASE_SIEVE);
+
+    ApContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.presieve = &presieve;
+    ctx.primes = primes + skip;
+    ctx.nprimes = nprimes - skip;
+    ctx.max_modulus = opts->ap_moduli;
+    ctx.residue = opts->ap_residue;
+    ctx.modulus = opts->ap_modulus;
+    ctx.list = opts->list && !ctx.max_modulus;
+
+    long long ncounts = 0;
+    if (ctx.max_modulus) {
+        ctx.first_top = ctx.max_modulus / 2 + 1;
+        ctx.offsets = (long long *)malloc(sizeof(long long) * (size_t)(ctx.max_modulus + 1));
+        if (!ctx.offsets) {
+            fprintf(stderr, "Error: failed to allocate progression offsets\n");
+            exit(EXIT_FAILURE);
+        }
+        for (long long m = ctx.first_top; m <= ctx.max_modulus; ++m) {
+            ctx.offsets[m] = ncounts;
+            ncounts += m;
+        }
+    }
+
+    int nthreads = (int)opts->thread_count;
+    ctx.workers = (ApWorker *)calloc((size_t)nthreads, sizeof(ApWorker));
+    if (!ctx.workers) {
+        fprintf(stderr, "Error: failed to allocate progression workers\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < nthreads; ++t) {
+        ApWorker *w = &ctx.workers[t];
+        w->seg = (unsigned char *)malloc((size_t)opts->segment_size);
+        w->lanes = (unsigned short *)malloc(sizeof(unsigned short) * (size_t)(ctx.max_modulus + AP_MIN_ROW));
+        w->counts = (long long *)calloc((size_t)ncounts + 1, sizeof(long long));
+        if (!w->seg || !w->lanes || !w->counts) {
+            fprintf(stderr, "Error: failed to allocate progression buffers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    long long worker_bytes = (long long)nthreads * (opts->segment_size
+                                                    + (long long)sizeof(unsigned short) * (ctx.max_modulus + AP_MIN_ROW)
+                                                    + (long long)sizeof(long long) * (ncounts + 1));
+    mem_track(MEM_SEGMENTS, worker_bytes);
+
+    if (ctx.list) {
+        ordered_init(&ctx.output, nthreads, ordered_write_text, NULL);
+        printf("[ap] list:");
+    }
+
+    phase_begin(PHASE_SIEVE);
+    for_each_segment(0, opts->max_value + 1, opts->segment_size, nthreads, ap_segment_fn, &ctx);
+    phase_end(PHASE_SIEVE);
+
+    //merge into worker 0
+    ApWorker *all = &ctx.workers[0];
+    for (int t = 1; t < nthreads; ++t) {
+        all->matched += ctx.workers[t].matched;
+        for (long long k = 0; k < ncounts; ++k) all->counts[k] += ctx.workers[t].counts[k];
+    }
+    double ms = get_time(&my_timer);
+
+    if (ctx.list) printf("\n");
+    if (ctx.max_modulus) {
+        print_class_counts(&ctx, all->counts);
+    } else {
+        printf("[ap] primes = %lld mod %lld: %lld\n", ctx.residue, ctx.modulus, all->matched);
+    }
+    printf("[ap] elapsed: %.3f ms\n", ms);
+
+    for (int t = 0; t < nthreads; ++t) {
+        free(ctx.workers[t].seg);
+        free(ctx.workers[t].lanes);
+        free(ctx.workers[t].counts);
+    }
+    mem_track(MEM_SEGMENTS, -worker_bytes);
+    free(ctx.workers);
+    free(ctx.offsets);
+    if (ctx.list) ordered_free(&ctx.output);
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+    presieve_free(&presieve);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+//
+//  randprime.c
+//  CPrimeFinder
+//
+//  Uniformly random primes from a range (--random-primes K --in [lo,hi]).
+//  The K primes are cut into chunks of RANDOM_CHUNK, handed out by
+//  for_each_segment, and chunk c draws from its own xoshiro256** stream,
+//  seeded from outputs 4c to 4c + 3 of splitmix64 started at --seed. The
+//  output then depends on the seed alone, not on the thread count.
+//
+//  Candidates are drawn independently and uniformly from the range, so every
+//  prime in it is equally likely and repeats are as rare as chance makes
+//  them. Sieving a random window would have been cheaper per candidate, but
+//  its primes are neighbours and, sampled often enough to pay for the sieve,
+//  they repeat within the window. Instead a batch of RANDOM_BATCH candidates
+//  goes through the odd primes up to RANDOM_TRIAL_LIMIT one prime at a time,
+//  keeping the survivors in order: each test is a multiply by the prime's
+//  inverse mod 2^64 (2^128 for wider ranges) and a compare, with no division
+//  and no branch. About one odd candidate in six is left for is_prime_u128,
+//  and none at all when the trial primes reach the square root of the
+//  candidate.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+#define RANDOM_CHUNK 4096
+#define RANDOM_BATCH 512
+#define RANDOM_TRIAL_LIMIT 1024
+
+typedef struct {
+    unsigned long long s[4];
+} Xoshiro;
+
+//n is a multiple of p exactly when n * inverse <= bound, for n below 2^64 or 2^128
+typedef struct {
+    u128 inverse;
+    u128 bound;
+    unsigned long long bound64;
+} RandomTrial;
+
+typedef struct {
+    u128 lo;
+    u128 span;                // hi - lo
+    u128 mask;                // smallest 2^k - 1 covering span
+    int wide;                 // hi >= 2^64
+    RandomTrial *trial;
+    int ntrial;
+    u128 exact_below;         // survivors below this are prime
+    unsigned long long seed;
+    OrderedOutput output;     // each chunk's primes, printed in chunk order
+} RandomContext;
+
+static unsigned long long splitmix64(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline unsigned long long rotl(unsigned long long x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline unsigned long long xoshiro_next(Xoshiro *x) {
+    unsigned long long *s = x->s;
+    unsigned long long result = rotl(s[1] * 5, 7) * 9;
+    unsigned long long t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+static void xoshiro_seed(Xoshiro *x, unsigned long long seed, long long chunk) {
+    unsigned long long state = seed + 4ULL * (unsigned long long)chunk * 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 4; ++i) x->s[i] = splitmix64(&state);
+}
+
+//Uniform odd number or 2 in [lo, hi], by masking and rejecting
+static inline u128 random_candidate(const RandomContext *ctx, Xoshiro *x) {
+    for (;;) {
+        u128 r = xoshiro_next(x);
+        if (ctx->wide) r = (r << 64) | xoshiro_next(x);
+        r &= ctx->mask;
+        if (r > ctx->span) continue;
+        u128 n = ctx->lo + r;
+        if ((n & 1) || n == 2) return n;
+    }
+}
+
+//Drops the candidates with an odd prime factor up to RANDOM_TRIAL_LIMIT, keeping
+//their order; the ones up to the limit are kept for is_prime_u64 to decide
+static int trial_filter(const RandomContext *ctx, u128 *c, int count) {
+    if (!ctx->wide) {
+        //below 2^64 the batch is repacked as 64-bit words
+        unsigned long long c64[RANDOM_BATCH];
+        for (int j = 0; j < count; ++j) c64[j] = (unsigned long long)c[j];
+        for (int k = 0; k < ctx->ntrial && count; ++k) {
+            unsigned long long inverse = (unsigned long long)ctx->trial[k].inverse;
+            unsigned long long bound = ctx->trial[k].bound64;
+            int m = 0;
+            for (int j = 0; j < count; ++j) {
+                unsigned long long n = c64[j];
+                c64[m] = n;
+                m += n * inverse > bound || n <= RANDOM_TRIAL_LIMIT;
+            }
+            count = m;
+        }
+        for (int j = count - 1; j >= 0; --j) c[j] = c64[j];
+        return count;
+    }
+    for (int k = 0; k < ctx->ntrial && count; ++k) {
+        u128 inverse = ctx->trial[k].inverse;
+        u128 bound = ctx->trial[k].bound;
+        int m = 0;
+        for (int j = 0; j < count; ++j) {
+            u128 n = c[j];
+            c[m] = n;
+            m += n * inverse > bound || n <= RANDOM_TRIAL_LIMIT;
+        }
+        count = m;
+    }
+    return count;
+}
+
+static void random_chunk_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    (void)thread_id;
+    RandomContext *ctx = (RandomContext *)arg;
+    Xoshiro rng;
+    xoshiro_seed(&rng, ctx->seed, index);
+    long long wanted = hi - lo, found = 0;
+    TextBuf *out = text_new();
+    text_reserve(out, (size_t)wanted * (U128_DIGITS + 1));
+    u128 batch[RANDOM_BATCH];
+    while (found < wanted) {
+        for (int j = 0; j < RANDOM_BATCH; ++j) batch[j] = random_candidate(ctx, &rng);
+        int survivors = trial_filter(ctx, batch, RANDOM_BATCH);
+        for (int j = 0; j < survivors && found < wanted; ++j) {
+            u128 n = batch[j];
+            int prime = n > RANDOM_TRIAL_LIMIT && n < ctx->exact_below ? 1 : is_prime_u128(n);
+            if (!prime) continue;
+            u128_format(n, out->text + out->len);
+            out->len += strlen(out->text + out->len);
+            out->text[out->len++] = '\n';
+            found++;
+        }
+    }
+    ordered_put(&ctx->output, index, out);
+}
+
+//Prints opts->random_primes primes drawn uniformly from [random_lo, random_hi]
+int run_random_primes(const Options *opts, RunResult *result) {
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    RandomContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.lo = opts->random_lo;
+    ctx.span = opts->random_hi - opts->random_lo;
+    ctx.wide = (opts->random_hi >> 64) != 0;
+    ctx.seed = opts->seed;
+    while (ctx.mask < ctx.span) ctx.mask = (ctx.mask << 1) | 1;
+
+    //a range without primes would never finish
+    u128 first = ctx.lo < 2 ? 2 : ctx.lo;
+    while (first <= opts->random_hi && !is_prime_u128(first)) {
+        if (++first == 0) break;
+    }
+    if (first == 0 || first > opts->random_hi) {
+        char lo_digits[U128_DIGITS + 1], hi_digits[U128_DIGITS + 1];
+        fprintf(stderr, "Error: there are no primes in [%s, %s].\n", u128_format(opts->random_lo, lo_digits),
+                u128_format(opts->random_hi, hi_digits));
+        return EXIT_FAILURE;
+    }
+
+    phase_begin(PHASE_BASE_SIEVE);
+    long long nprimes = 0;
+    long long *primes = sieve_base_primes(RANDOM_TRIAL_LIMIT, &nprimes);
+    ctx.trial = (RandomTrial *)malloc(sizeof(RandomTrial) * (size_t)nprimes);
+    if (!ctx.trial) {
+        fprintf(stderr, "Error: failed to set up random prime generation\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long long k = 0; k < nprimes; ++k) {
+        u128 p = (u128)primes[k];
+        u128 inv = p;
+        for (int i = 0; i < 6; ++i) inv *= 2 - p * inv;
+        ctx.trial[k].inverse = inv;
+        ctx.trial[k].bound = ~(u128)0 / p;
+        ctx.trial[k].bound64 = ~0ULL / (unsigned long long)p;
+    }
+    ctx.ntrial = (int)nprimes;
+    ctx.exact_below = (u128)primes[nprimes - 1] * (u128)primes[nprimes - 1];
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+    phase_end(PHASE_BASE_SIEVE);
+
+    phase_begin(PHASE_SIEVE);
+    ordered_init(&ctx.output, (int)opts->thread_count, ordered_write_text, NULL);
+    for_each_segment(0, opts->random_primes, RANDOM_CHUNK, (int)opts->thread_count, random_chunk_fn, &ctx);
+    phase_end(PHASE_SIEVE);
+    printf("[random] primes: %lld in %.3f ms\n", opts->random_primes, get_time(&my_timer));
+
+    ordered_free(&ctx.output);
+    free(ctx.trial);
+
+    result->numbers = opts->random_primes;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+//
+//  report.c
+//  CPrimeFinder
+//
+//  Machine-readable run record (--report=json|csv) for benchmark_pprimes.py
+//  and dashboards: parameters, timings per phase, counts, memory and hardware
+//  counters, written as one JSON object or a CSV header plus one row.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pprimes.h"
+
+static double counter_total(Counter c) {
+    double total = 0.0;
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        double v = counter_value((Phase)p, c);
+        if (v < 0.0) return -1.0;
+        total += v;
+    }
+    return total;
+}
+
+static void write_json(FILE *out, const Options *opts, const RunResult *r) {
+    fprintf(out, "{\"engine\": \"%s\", \"max_value\": %lld, \"threads\": %lld, ",
+            engine_label(opts), opts->max_value, opts->thread_count);
+    fprintf(out, "\"segment_size\": %lld, \"presieve_depth\": %d, \"chunk_size\": %lld, \"isa\": \"%s\", ",
+            opts->segment_size, opts->presieve_depth, opts->chunk_size, isa_name(simd_isa()));
+    fprintf(out, "\"total_primes\": %lld, \"elapsed_ms\": %.3f, \"peak_rss_bytes\": %lld, ",
+            r->total_primes, r->elapsed_ms, peak_rss_bytes());
+    long long minor, major;
+    page_faults(&minor, &major);
+    fprintf(out, "\"minor_faults\": %lld, \"major_faults\": %lld, \"alloc_peak_bytes\": {", minor, major);
+    for (int k = 0; k < NUM_MEM_KINDS; ++k) {
+        fprintf(out, "%s\"%s\": %lld", k ? ", " : "", mem_name((MemKind)k), mem_peak_bytes((MemKind)k));
+    }
+    fprintf(out, ", \"total\": %lld}, ", mem_total_peak_bytes());
+    fprintf(out, "\"phases_ms\": {");
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", phase_name((Phase)p), phase_ms((Phase)p));
+    }
+    fprintf(out, "}, \"counters\": ");
+    if (!counters_enabled()) {
+        fprintf(out, "null}\n");
+        return;
+    }
+    fprintf(out, "{");
+    for (int p = 0; p < NUM_PHASES; ++p) {
+        fprintf(out, "%s\"%s\": {", p ? ", " : "", phase_name((Phase)p));
+        for (int c = 0; c < NUM_COUNTERS; ++c) {
+            double v = counter_value((Phase)p, (Counter)c);
+            if (v < 0.0) fprintf(out, "%s\"%s\": null", c ? ", " : "", counter_name((Counter)c));
+            else fprintf(out, "%s\"%s\": %.0f", c ? ", " : "", counter_name((Counter)c), v);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}}\n");
+}
+
+static void write_csv(FILE *out, const Options *opts, const RunResult *r) {
+    fprintf(out, "engine,max_value,threads,segment_size,presieve_depth,chunk_size,isa,total_primes,elapsed_ms,peak_rss_bytes");
+    fprintf(out, ",minor_faults,major_faults");
+    for (int k = 0; k < NUM_MEM_KINDS; ++k) fprintf(out, ",%s_bytes", mem_name((MemKind)k));
+    fprintf(out, ",alloc_peak_bytes");
+    for (int p = 0; p < NUM_PHASES; ++p) fprintf(out, ",%s_ms", phase_name((Phase)p));
+    for (int c = 0; c < NUM_COUNTERS; ++c) fprintf(out, ",%s", counter_name((Counter)c));
+    fprintf(out, "\n");
+
+    fprintf(out, "%s,%lld,%lld,%lld,%d,%lld,%s,%lld,%.3f,%lld", engine_label(opts), opts->max_value,
+            opts->thread_count, opts->segment_size, opts->presieve_depth, opts->chunk_size, isa_name(simd_isa()),
+            r->total_primes, r->elapsed_ms, peak_rss_bytes());
+    long long minor, major;
+    page_faults(&minor, &major);
+    fprintf(out, ",%lld,%lld", minor, major);
+    for (int k = 0; k < NUM_MEM_KINDS; ++k) fprintf(out, ",%lld", mem_peak_bytes((MemKind)k));
+    fprintf(out, ",%lld", mem_total_peak_bytes());
+    for (int p = 0; p < NUM_PHASES; ++p) fprintf(out, ",%.3f", phase_ms((Phase)p));
+    for (int c = 0; c < NUM_COUNTERS; ++c) {
+        double v = counters_enabled() ? counter_total((Counter)c) : -1.0;
+        if (v < 0.0) fprintf(out, ",");
+        else fprintf(out, ",%.0f", v);
+    }
+    fprintf(out, "\n");
+}
+
+//Writes the record in the format chosen by --report
+void write_report(FILE *out, const Options *opts, const RunResult *r) {
+    if (opts->report == REPORT_JSON) write_json(out, opts, r);
+    else if (opts->report == REPORT_CSV) write_csv(out, opts, r);
+    fflush(out);
+}
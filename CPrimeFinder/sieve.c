@@ -0,0 +1,288 @@
+//
+//  sieve.c
+//  CPrimeFinder
+//
+//  Segmented Sieve of Eratosthenes: base primes, the small-prime pre-sieve
+//  pattern, crossing-off, and a thread pool that hands out segments.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+//primes that can be folded into the pre-sieve pattern, in order
+static const int presieve_primes[] = { 2, 3, 5, 7, 11, 13, 17 };
+
+//floor(sqrt(n)) without floating point rounding surprises. Newton's step falls
+//monotonically from any start at or above the root; the start is clamped to
+//floor(sqrt(LLONG_MAX)) so that n near 2^63 cannot overflow
+long long isqrt_ll(long long n) {
+    if (n < 2) return n;
+    int bits = 64 - __builtin_clzll((unsigned long long)n);
+    long long r = 1LL << ((bits + 1) / 2);
+    if (r > 3037000499LL) r = 3037000499LL;
+    for (;;) {
+        long long next = (r + n / r) / 2;
+        if (next >= r) return r;
+        r = next;
+    }
+}
+
+//Odd primes up to limit using a simple sieve (they cross off the segments)
+long long *sieve_base_primes(long long limit, long long *count) {
+    *count = 0;
+    if (limit < 3) return NULL;
+    unsigned char *composite = (unsigned char *)calloc((size_t)limit + 1, 1);
+    if (!composite) {
+        fprintf(stderr, "Error: failed to allocate base prime sieve\n");
+        exit(EXIT_FAILURE);
+    }
+    mem_track(MEM_BASE_PRIMES, limit + 1);
+    long long n = 0;
+    for (long long i = 3; i <= limit; i += 2) {
+        if (composite[i]) continue;
+        n++;
+        for (long long j = i * i; j <= limit; j += 2 * i) composite[j] = 1;
+    }
+    long long *primes = (long long *)malloc(sizeof(long long) * (size_t)n);
+    if (!primes) {
+        fprintf(stderr, "Error: failed to allocate base primes\n");
+        exit(EXIT_FAILURE);
+    }
+    mem_track(MEM_BASE_PRIMES, (long long)sizeof(long long) * n);
+    long long k = 0;
+    for (long long i = 3; i <= limit; i += 2) {
+        if (!composite[i]) primes[k++] = i;
+    }
+    free(composite);
+    mem_track(MEM_BASE_PRIMES, -(limit + 1));
+    *count = n;
+    return primes;
+}
+
+//Builds the repeating pattern of numbers coprime to the first depth primes
+void presieve_init(PreSieve *ps, int depth) {
+    int max_depth = (int)(sizeof(presieve_primes) / sizeof(presieve_primes[0]));
+    if (depth < 1) depth = 1;
+    if (depth > max_depth) depth = max_depth;
+    long long period = 1;
+    for (int i = 0; i < depth; ++i) period *= presieve_primes[i];
+
+    ps->depth = depth;
+    ps->period = period;
+    ps->largest = presieve_primes[depth - 1];
+    ps->pattern = (unsigned char *)malloc((size_t)period);
+    if (!ps->pattern) {
+        fprintf(stderr, "Error: failed to allocate pre-sieve pattern\n");
+        exit(EXIT_FAILURE);
+    }
+    mem_track(MEM_SEGMENTS, period);
+    memset(ps->pattern, 1, (size_t)period);
+    for (int i = 0; i < depth; ++i) {
+        int p = presieve_primes[i];
+        for (long long j = 0; j < period; j += p) ps->pattern[j] = 0;
+    }
+}
+
+void presieve_free(PreSieve *ps) {
+    if (ps->pattern) mem_track(MEM_SEGMENTS, -ps->period);
+    free(ps->pattern);
+    ps->pattern = NULL;
+}
+
+//Repeats pattern (one period long) over seg, where seg[i] stands for the number lo + i
+void pattern_fill(const unsigned char *pattern, long long period, unsigned char *seg, long long lo, long long len) {
+    long long offset = lo % period;
+    long long done = 0;
+    while (done < len) {
+        long long run = period - offset;
+        if (run > len - done) run = len - done;
+        memcpy(seg + done, pattern + offset, (size_t)run);
+        done += run;
+        offset = 0;
+    }
+}
+
+//Copies the pattern into seg, where seg[i] stands for the number lo + i
+void presieve_fill(const PreSieve *ps, unsigned char *seg, long long lo, long long len) {
+    pattern_fill(ps->pattern, ps->period, seg, lo, len);
+    //the pattern clears the pattern primes themselves, and 0 and 1 look coprime
+    for (long long n = lo; n < lo + len && n <= ps->largest; ++n) {
+        if (n < 2) {
+            seg[n - lo] = 0;
+            continue;
+        }
+        for (int i = 0; i < ps->depth; ++i) {
+            if (presieve_primes[i] == n) seg[n - lo] = 1;
+        }
+    }
+}
+
+//Clears odd multiples of the base primes (from p*p on) in seg = [lo, lo + len)
+void cross_off_segment(unsigned char *seg, long long lo, long long len,
+                       const long long *primes, long long nprimes) {
+    long long hi = lo + len;
+    for (long long k = 0; k < nprimes; ++k) {
+        long long p = primes[k];
+        if (p * p >= hi) break;
+        long long m = ((lo + p - 1) / p) * p;
+        if (m < p * p) m = p * p;
+        if ((m & 1LL) == 0) m += p;
+        for (; m < hi; m += 2 * p) seg[m - lo] = 0;
+    }
+}
+
+//State shared by the segment workers
+typedef struct {
+    long long lo;
+    long long hi;
+    long long segment_size;
+    long long next_segment;
+    pthread_mutex_t lock;
+    SegmentFn fn;
+    void *ctx;
+} SegmentWork;
+
+typedef struct {
+    SegmentWork *work;
+    int thread_id;
+} SegmentWorker;
+
+//Pulls segment indices off the shared counter until the range is exhausted
+static void *segment_work_function(void *arg) {
+    SegmentWorker *worker = (SegmentWorker *)arg;
+    SegmentWork *w = worker->work;
+    WorkerStats *stats = thread_stats_worker(worker->thread_id);
+    int tracing = trace_enabled();
+    int timed = stats || tracing;
+    unsigned long long started = timed ? tsc_now() : 0, lock_ticks = 0;
+    for (;;) {
+        long long index;
+        unsigned long long t0 = timed ? tsc_now() : 0;
+        pthread_mutex_lock(&w->lock);
+        unsigned long long t1 = timed ? tsc_now() : 0;
+        index = w->next_segment++;
+        pthread_mutex_unlock(&w->lock);
+        unsigned long long t2 = timed ? tsc_now() : 0;
+        if (stats) {
+            thread_stats_lock(stats, t1 - t0, t2 - t1);
+            lock_ticks += t2 - t0;
+        }
+        if (tracing) trace_event("lock wait", t0, t1, index);
+
+        long long seg_lo = w->lo + index * w->segment_size;
+        if (seg_lo >= w->hi) break;
+        long long seg_hi = seg_lo + w->segment_size;
+        if (seg_hi > w->hi) seg_hi = w->hi;
+        if (stats) stats->items++;
+        w->fn(w->ctx, worker->thread_id, index, seg_lo, seg_hi);
+        if (tracing) trace_event("segment", t2, tsc_now(), seg_lo);
+    }
+    if (stats) stats->busy_ticks += tsc_now() - started - lock_ticks;
+    return NULL;
+}
+
+//Entry point for spawned workers; the caller's own work is counted by its phase
+static void *segment_thread_function(void *arg) {
+    counters_thread_begin();
+    segment_work_function(arg);
+    counters_thread_end();
+    trace_thread_end();
+    return NULL;
+}
+
+//Calls fn on every segment of [lo, hi) using nthreads workers
+void for_each_segment(long long lo, long long hi, long long segment_size, int nthreads,
+                      SegmentFn fn, void *ctx) {
+    SegmentWork work;
+    work.lo = lo;
+    work.hi = hi;
+    work.segment_size = segment_size;
+    work.next_segment = 0;
+    work.fn = fn;
+    work.ctx = ctx;
+    if (pthread_mutex_init(&work.lock, NULL) != 0) {
+        fprintf(stderr, "Error: failed to initialize mutex\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nthreads < 1) nthreads = 1;
+    thread_stats_prepare(nthreads);
+
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * (size_t)nthreads);
+    SegmentWorker *workers = (SegmentWorker *)malloc(sizeof(SegmentWorker) * (size_t)nthreads);
+    if (!threads || !workers) {
+        fprintf(stderr, "Error: failed to allocate thread handles\n");
+        exit(EXIT_FAILURE);
+    }
+    long long handle_bytes = (long long)(sizeof(pthread_t) + sizeof(SegmentWorker)) * nthreads;
+    mem_track(MEM_THREADS, handle_bytes);
+
+    for (int i = 0; i < nthreads; ++i) {
+        workers[i].work = &work;
+        workers[i].thread_id = i;
+    }
+    //thread 0 is the caller, so a single thread never spawns anything
+    for (int i = 1; i < nthreads; ++i) {
+        int rc = pthread_create(&threads[i], NULL, segment_thread_function, &workers[i]);
+        if (rc != 0) {
+            fprintf(stderr, "Error: pthread_create failed (%d)\n", rc);
+            exit(EXIT_FAILURE);
+        }
+    }
+    segment_work_function(&workers[0]);
+    for (int i = 1; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(workers);
+    free(threads);
+    mem_track(MEM_THREADS, -handle_bytes);
+    pthread_mutex_destroy(&work.lock);
+}
+
+//Shared read-only inputs of the segmented engine
+typedef struct {
+    unsigned char *is_prime_arr;
+    const PreSieve *presieve;
+    const long long *primes;
+    long long nprimes;
+} SieveContext;
+
+static void sieve_segment_fn(void *arg, int thread_id, long long index, long long lo, long long hi) {
+    (void)thread_id;
+    (void)index;
+    SieveContext *ctx = (SieveContext *)arg;
+    unsigned char *seg = ctx->is_prime_arr + lo;
+    presieve_fill(ctx->presieve, seg, lo, hi - lo);
+    cross_off_segment(seg, lo, hi - lo, ctx->primes, ctx->nprimes);
+}
+
+//Runs the segmented sieve over [0, max_value] writing straight into the results array
+void run_segmented(const Options *opts, unsigned char *is_prime_arr) {
+    phase_begin(PHASE_BASE_SIEVE);
+    PreSieve presieve;
+    presieve_init(&presieve, opts->presieve_depth);
+
+    long long nprimes = 0;
+    long long *primes = sieve_base_primes(isqrt_ll(opts->max_value), &nprimes);
+    phase_end(PHASE_BASE_SIEVE);
+
+    //the pattern already removed the smallest primes' multiples
+    long long skip = 0;
+    while (skip < nprimes && primes[skip] <= presieve.largest) skip++;
+
+    SieveContext ctx;
+    ctx.is_prime_arr = is_prime_arr;
+    ctx.presieve = &presieve;
+    ctx.primes = primes + skip;
+    ctx.nprimes = nprimes - skip;
+    for_each_segment(0, opts->max_value + 1, opts->segment_size, (int)opts->thread_count,
+                     sieve_segment_fn, &ctx);
+
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+    presieve_free(&presieve);
+}
@@ -0,0 +1,339 @@
+//
+//  simd.c
+//  CPrimeFinder
+//
+//  Vector kernels with runtime CPU dispatch. Each kernel is built in scalar,
+//  SSE4.2, AVX2 and AVX-512 variants using per-function target attributes, so
+//  one binary carries all of them; simd_init picks the widest one the CPU
+//  supports (or the one forced with --isa). Builds for anything but x86-64
+//  get the scalar variants only.
+//
+//  Kernels:
+//    count_nonzero  primes in a results range (nonzero bytes)
+//    next_nonzero   index of the next prime, for formatting
+//    small_factor   divisibility of a 32-bit n by the odd primes up to
+//                   SMALL_PRIME_MAX, as n * d^-1 mod 2^32 <= (2^32 - 1) / d
+//    add_bytes      widening add of a byte row into 16-bit lanes, for --ap
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pprimes.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#define NUM_SMALL_PRIMES 64     // odd primes 3..SMALL_PRIME_MAX
+
+static const char *isa_names[NUM_ISAS] = { "auto", "scalar", "sse4.2", "avx2", "avx512" };
+
+//For each odd prime d up to SMALL_PRIME_MAX: d^-1 mod 2^32 and (2^32 - 1) / d
+static uint32_t small_inverses[NUM_SMALL_PRIMES] __attribute__((aligned(64)));
+static uint32_t small_limits[NUM_SMALL_PRIMES] __attribute__((aligned(64)));
+static int small_tables_ready = 0;
+
+static void build_small_tables(void) {
+    int k = 0;
+    for (uint32_t d = 3; k < NUM_SMALL_PRIMES; d += 2) {
+        int prime = 1;
+        for (uint32_t q = 3; q * q <= d; q += 2) {
+            if (d % q == 0) prime = 0;
+        }
+        if (!prime) continue;
+        //Newton's iteration doubles the correct low bits each step: 3 -> 6 -> 12 -> 24 -> 48
+        uint32_t inv = d;
+        for (int i = 0; i < 4; ++i) inv *= 2 - d * inv;
+        small_inverses[k] = inv;
+        small_limits[k] = UINT32_MAX / d;
+        k++;
+    }
+    small_tables_ready = 1;
+}
+
+//-------- scalar --------
+
+static long long count_nonzero_scalar(const unsigned char *p, long long len) {
+    long long count = 0;
+    for (long long i = 0; i < len; ++i) count += p[i] != 0;
+    return count;
+}
+
+static long long next_nonzero_scalar(const unsigned char *p, long long from, long long to) {
+    while (from < to && !p[from]) from++;
+    return from;
+}
+
+static int small_factor_scalar(uint32_t n) {
+    for (int i = 0; i < NUM_SMALL_PRIMES; ++i) {
+        if (n * small_inverses[i] <= small_limits[i]) return 1;
+    }
+    return 0;
+}
+
+static void add_bytes_scalar(uint16_t *lanes, const unsigned char *p, long long len) {
+    for (long long i = 0; i < len; ++i) lanes[i] += p[i];
+}
+
+#ifdef SIMD_X86
+
+//-------- SSE4.2 (16 bytes, 4 lanes) --------
+
+__attribute__((target("sse4.2")))
+static long long count_nonzero_sse42(const unsigned char *p, long long len) {
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    long long i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_min_epu8(v, ones), zero));
+    }
+    long long count = _mm_cvtsi128_si64(acc) + _mm_extract_epi64(acc, 1);
+    return count + count_nonzero_scalar(p + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static long long next_nonzero_sse42(const unsigned char *p, long long from, long long to) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; from + 16 <= to; from += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + from));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xFFFFu;
+        if (mask) return from + __builtin_ctz(mask);
+    }
+    return next_nonzero_scalar(p, from, to);
+}
+
+__attribute__((target("sse4.2")))
+static int small_factor_sse42(uint32_t n) {
+    const __m128i vn = _mm_set1_epi32((int)n);
+    for (int i = 0; i < NUM_SMALL_PRIMES; i += 4) {
+        __m128i q = _mm_mullo_epi32(vn, _mm_load_si128((const __m128i *)(small_inverses + i)));
+        __m128i lim = _mm_load_si128((const __m128i *)(small_limits + i));
+        //unsigned q <= lim exactly when min(q, lim) == q
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_min_epu32(q, lim), q))) return 1;
+    }
+    return 0;
+}
+
+__attribute__((target("sse4.2")))
+static void add_bytes_sse42(uint16_t *lanes, const unsigned char *p, long long len) {
+    long long i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(p + i)));
+        __m128i acc = _mm_loadu_si128((const __m128i *)(lanes + i));
+        _mm_storeu_si128((__m128i *)(lanes + i), _mm_add_epi16(acc, v));
+    }
+    add_bytes_scalar(lanes + i, p + i, len - i);
+}
+
+//-------- AVX2 (32 bytes, 8 lanes) --------
+
+__attribute__((target("avx2")))
+static long long count_nonzero_avx2(const unsigned char *p, long long len) {
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    long long i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_min_epu8(v, ones), zero));
+    }
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    long long count = _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1);
+    return count + count_nonzero_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static long long next_nonzero_avx2(const unsigned char *p, long long from, long long to) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (; from + 32 <= to; from += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + from));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if (mask) return from + __builtin_ctz(mask);
+    }
+    return next_nonzero_scalar(p, from, to);
+}
+
+__attribute__((target("avx2")))
+static int small_factor_avx2(uint32_t n) {
+    const __m256i vn = _mm256_set1_epi32((int)n);
+    for (int i = 0; i < NUM_SMALL_PRIMES; i += 8) {
+        __m256i q = _mm256_mullo_epi32(vn, _mm256_load_si256((const __m256i *)(small_inverses + i)));
+        __m256i lim = _mm256_load_si256((const __m256i *)(small_limits + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_min_epu32(q, lim), q))) return 1;
+    }
+    return 0;
+}
+
+__attribute__((target("avx2")))
+static void add_bytes_avx2(uint16_t *lanes, const unsigned char *p, long long len) {
+    long long i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + i)));
+        __m256i acc = _mm256_loadu_si256((const __m256i *)(lanes + i));
+        _mm256_storeu_si256((__m256i *)(lanes + i), _mm256_add_epi16(acc, v));
+    }
+    add_bytes_scalar(lanes + i, p + i, len - i);
+}
+
+//-------- AVX-512 (64 bytes, 16 lanes) --------
+
+__attribute__((target("avx512f,avx512bw")))
+static long long count_nonzero_avx512(const unsigned char *p, long long len) {
+    long long count = 0;
+    long long i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(p + i));
+        count += __builtin_popcountll(_mm512_test_epi8_mask(v, v));
+    }
+    return count + count_nonzero_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static long long next_nonzero_avx512(const unsigned char *p, long long from, long long to) {
+    for (; from + 64 <= to; from += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(p + from));
+        unsigned long long mask = _mm512_test_epi8_mask(v, v);
+        if (mask) return from + __builtin_ctzll(mask);
+    }
+    return next_nonzero_scalar(p, from, to);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int small_factor_avx512(uint32_t n) {
+    const __m512i vn = _mm512_set1_epi32((int)n);
+    for (int i = 0; i < NUM_SMALL_PRIMES; i += 16) {
+        __m512i q = _mm512_mullo_epi32(vn, _mm512_load_si512((const void *)(small_inverses + i)));
+        if (_mm512_cmple_epu32_mask(q, _mm512_load_si512((const void *)(small_limits + i)))) return 1;
+    }
+    return 0;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void add_bytes_avx512(uint16_t *lanes, const unsigned char *p, long long len) {
+    long long i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m512i v = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(p + i)));
+        __m512i acc = _mm512_loadu_si512((const void *)(lanes + i));
+        _mm512_storeu_si512((void *)(lanes + i), _mm512_add_epi16(acc, v));
+    }
+    add_bytes_scalar(lanes + i, p + i, len - i);
+}
+
+#endif /* SIMD_X86 */
+
+//Selected variants; scalar until simd_init runs
+static Isa active_isa = ISA_SCALAR;
+static long long (*count_nonzero_fn)(const unsigned char *, long long) = count_nonzero_scalar;
+static long long (*next_nonzero_fn)(const unsigned char *, long long, long long) = next_nonzero_scalar;
+static int (*small_factor_fn)(uint32_t) = small_factor_scalar;
+static void (*add_bytes_fn)(uint16_t *, const unsigned char *, long long) = add_bytes_scalar;
+
+const char *isa_name(Isa isa) {
+    return isa_names[isa];
+}
+
+//Looks up an --isa value; returns 0 for an unknown name
+int parse_isa(const char *name, Isa *out) {
+    for (int i = 0; i < NUM_ISAS; ++i) {
+        if (strcmp(name, isa_names[i]) == 0) {
+            *out = (Isa)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Whether this CPU (and build) can run isa
+int isa_supported(Isa isa) {
+    if (isa == ISA_AUTO || isa == ISA_SCALAR) return 1;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    switch (isa) {
+        case ISA_SSE42: return __builtin_cpu_supports("sse4.2");
+        case ISA_AVX2: return __builtin_cpu_supports("avx2");
+        case ISA_AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        default: return 0;
+    }
+#else
+    return 0;
+#endif
+}
+
+//Selects the kernels for isa (the widest supported one for ISA_AUTO); returns 0 if isa is unsupported
+int simd_init(Isa isa) {
+    if (!small_tables_ready) build_small_tables();
+    if (isa == ISA_AUTO) {
+        isa = ISA_SCALAR;
+        for (int i = NUM_ISAS - 1; i > ISA_SCALAR; --i) {
+            if (isa_supported((Isa)i)) {
+                isa = (Isa)i;
+                break;
+            }
+        }
+    }
+    if (!isa_supported(isa)) {
+        fprintf(stderr, "Error: this CPU does not support --isa=%s.\n", isa_names[isa]);
+        return 0;
+    }
+    active_isa = isa;
+    switch (isa) {
+#ifdef SIMD_X86
+        case ISA_SSE42:
+            count_nonzero_fn = count_nonzero_sse42;
+            next_nonzero_fn = next_nonzero_sse42;
+            small_factor_fn = small_factor_sse42;
+            add_bytes_fn = add_bytes_sse42;
+            break;
+        case ISA_AVX2:
+            count_nonzero_fn = count_nonzero_avx2;
+            next_nonzero_fn = next_nonzero_avx2;
+            small_factor_fn = small_factor_avx2;
+            add_bytes_fn = add_bytes_avx2;
+            break;
+        case ISA_AVX512:
+            count_nonzero_fn = count_nonzero_avx512;
+            next_nonzero_fn = next_nonzero_avx512;
+            small_factor_fn = small_factor_avx512;
+            add_bytes_fn = add_bytes_avx512;
+            break;
+#endif
+        default:
+            count_nonzero_fn = count_nonzero_scalar;
+            next_nonzero_fn = next_nonzero_scalar;
+            small_factor_fn = small_factor_scalar;
+            add_bytes_fn = add_bytes_scalar;
+            break;
+    }
+    return 1;
+}
+
+Isa simd_isa(void) {
+    return active_isa;
+}
+
+//Number of nonzero bytes in p[0, len)
+long long simd_count_nonzero(const unsigned char *p, long long len) {
+    return count_nonzero_fn(p, len);
+}
+
+//First index in [from, to) with p[index] != 0, or to
+long long simd_next_nonzero(const unsigned char *p, long long from, long long to) {
+    return next_nonzero_fn(p, from, to);
+}
+
+//1 if an odd prime up to SMALL_PRIME_MAX divides n; callers keep n above SMALL_PRIME_MAX
+int simd_small_factor(unsigned int n) {
+    if (!small_tables_ready) build_small_tables();
+    return small_factor_fn(n);
+}
+
+//lanes[i] += p[i] for i in [0, len)
+void simd_add_bytes(unsigned short *lanes, const unsigned char *p, long long len) {
+    add_bytes_fn(lanes, p, len);
+}
@@ -0,0 +1,149 @@
+//
+//  spf.c
+//  CPrimeFinder
+//
+//  Smallest-prime-factor table (--spf). Only numbers coprime to 30 get an
+//  entry, 8 per 30 numbers, so the table costs 32/30 bytes per number with
+//  32-bit entries; 2, 3 and 5 are divided out before any lookup. Entries are
+//  filled by a linear sieve, which writes every composite exactly once as
+//  spf(c) * (c / spf(c)), and stay 0 for primes, so every stored factor is
+//  at most sqrt(limit). A factorization then takes one lookup per prime
+//  factor. Numbers to factor are read from stdin, one per line, and printed
+//  the way coreutils factor prints them.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+#define SPF_LINE 64
+
+//position of n % 30 among the residues coprime to 30, or -1
+static const signed char wheel_index[30] = {
+    -1, 0, -1, -1, -1, -1, -1, 1, -1, -1, -1, 2, -1, 3, -1, -1, -1, 4, -1, 5, -1, -1, -1, 6, -1, -1, -1, -1, -1, 7
+};
+static const int wheel_residues[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+
+//Table slot of n, which must be coprime to 30
+static inline long long spf_slot(long long n) {
+    return (n / 30) * 8 + wheel_index[n % 30];
+}
+
+//Fills the table for every n <= limit
+void spf_build(SpfTable *t, long long limit) {
+    t->limit = limit;
+    t->entries = (limit / 30 + 1) * 8;
+    t->spf = (unsigned int *)calloc((size_t)t->entries, sizeof(unsigned int));
+    if (!t->spf) {
+        fprintf(stderr, "Error: failed to allocate %lld smallest-factor entries\n", t->entries);
+        exit(EXIT_FAILURE);
+    }
+    mem_track(MEM_RESULTS, (long long)sizeof(unsigned int) * t->entries);
+
+    phase_begin(PHASE_BASE_SIEVE);
+    long long nprimes = 0;
+    long long *primes = sieve_base_primes(isqrt_ll(limit), &nprimes);
+    long long skip = 0;
+    while (skip < nprimes && primes[skip] < 7) skip++;
+    phase_end(PHASE_BASE_SIEVE);
+
+    //every composite c coprime to 30 is spf(c) * i with i coprime to 30 and i >= 7
+    phase_begin(PHASE_SIEVE);
+    long long last = limit / 7;
+    for (long long base = 0; base <= last; base += 30) {
+        for (int r = 0; r < 8; ++r) {
+            long long i = base + wheel_residues[r];
+            if (i < 7) continue;
+            if (i > last) break;
+            unsigned int s = t->spf[spf_slot(i)];
+            long long bound = s ? s : i;
+            long long max_p = limit / i;
+            if (max_p < bound) bound = max_p;
+            for (long long k = skip; k < nprimes && primes[k] <= bound; ++k) {
+                t->spf[spf_slot(primes[k] * i)] = (unsigned int)primes[k];
+            }
+        }
+    }
+    phase_end(PHASE_SIEVE);
+
+    free(primes);
+    mem_track(MEM_BASE_PRIMES, -(long long)sizeof(long long) * nprimes);
+}
+
+void spf_free(SpfTable *t) {
+    free(t->spf);
+    mem_track(MEM_RESULTS, -(long long)sizeof(unsigned int) * t->entries);
+    t->spf = NULL;
+}
+
+//Factors 1 <= n <= t->limit into ascending primes with exponents; returns how many
+int spf_factor(const SpfTable *t, long long n, long long *primes, int *exponents) {
+    static const int wheel_primes[3] = { 2, 3, 5 };
+    int count = 0;
+    for (int w = 0; w < 3; ++w) {
+        if (n % wheel_primes[w]) continue;
+        primes[count] = wheel_primes[w];
+        exponents[count] = 0;
+        while (n % wheel_primes[w] == 0) {
+            n /= wheel_primes[w];
+            exponents[count]++;
+        }
+        count++;
+    }
+    while (n > 1) {
+        unsigned int s = t->spf[spf_slot(n)];
+        long long p = s ? (long long)s : n;
+        if (count > 0 && primes[count - 1] == p) {
+            exponents[count - 1]++;
+        } else {
+            primes[count] = p;
+            exponents[count++] = 1;
+        }
+        n /= p;
+    }
+    return count;
+}
+
+//Builds the table up to max_value and factors each number read from stdin
+int run_spf(const Options *opts, RunResult *result) {
+    (void)result;
+    struct Timer my_timer;
+    timer_start(&my_timer);
+    SpfTable table;
+    spf_build(&table, opts->max_value);
+    double build_ms = get_time(&my_timer);
+    printf("[spf] table: %lld entries (%.1f MiB) in %.3f ms\n", table.entries,
+           (double)(sizeof(unsigned int) * (size_t)table.entries) / (1024.0 * 1024.0), build_ms);
+
+    int rc = EXIT_SUCCESS;
+    long long queries = 0;
+    char line[SPF_LINE];
+    long long primes[16];
+    int exponents[16];
+    timer_start(&my_timer);
+    phase_begin(PHASE_WRITE);
+    while (fgets(line, sizeof(line), stdin)) {
+        long long n;
+        if (line[strspn(line, " \t\r\n")] == '\0') continue;
+        if (!parse_integer_arguments(line, &n) || n < 1 || n > table.limit) {
+            line[strcspn(line, "\r\n")] = '\0';
+            fprintf(stderr, "Error: '%s' is not an integer in [1, %lld].\n", line, table.limit);
+            rc = EXIT_FAILURE;
+            continue;
+        }
+        int count = spf_factor(&table, n, primes, exponents);
+        printf("%lld:", n);
+        for (int k = 0; k < count; ++k) {
+            for (int e = 0; e < exponents[k]; ++e) printf(" %lld", primes[k]);
+        }
+        printf("\n");
+        queries++;
+    }
+    phase_end(PHASE_WRITE);
+    printf("[spf] queries: %lld in %.3f ms\n", queries, get_time(&my_timer));
+
+    spf_free(&table);
+    return rc;
+}
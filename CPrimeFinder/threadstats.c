@@ -0,0 +1,97 @@
+//
+//  threadstats.c
+//  CPrimeFinder
+//
+//  Per-worker statistics for the threaded and segmented engines
+//  (--thread-stats): items handed out, busy time, time waiting for and holding
+//  the work lock, and log2 histograms of the lock wait/hold times.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pprimes.h"
+
+static int stats_on = 0;
+static WorkerStats *workers = NULL;
+static int nworkers = 0;
+
+void thread_stats_init(void) {
+    stats_on = 1;
+    tsc_calibrate();
+}
+
+int thread_stats_enabled(void) {
+    return stats_on;
+}
+
+//Makes room for nthreads workers; repeated runs keep accumulating into the same slots
+void thread_stats_prepare(int nthreads) {
+    if (!stats_on || nthreads <= nworkers) return;
+    WorkerStats *grown = (WorkerStats *)realloc(workers, sizeof(WorkerStats) * (size_t)nthreads);
+    if (!grown) {
+        fprintf(stderr, "Error: failed to allocate thread statistics\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(grown + nworkers, 0, sizeof(WorkerStats) * (size_t)(nthreads - nworkers));
+    workers = grown;
+    nworkers = nthreads;
+}
+
+//Slot for one worker, or NULL when statistics are off
+WorkerStats *thread_stats_worker(int thread_id) {
+    if (!stats_on || thread_id >= nworkers) return NULL;
+    return &workers[thread_id];
+}
+
+static int log2_bucket(unsigned long long ns) {
+    int b = 0;
+    while (ns > 1 && b < STAT_BUCKETS - 1) {
+        ns >>= 1;
+        b++;
+    }
+    return b;
+}
+
+//Records one trip through the work lock (times in ticks)
+void thread_stats_lock(WorkerStats *s, unsigned long long wait_ticks, unsigned long long hold_ticks) {
+    s->wait_ticks += wait_ticks;
+    s->hold_ticks += hold_ticks;
+    s->wait_hist[log2_bucket((unsigned long long)tsc_to_ns(wait_ticks))]++;
+    s->hold_hist[log2_bucket((unsigned long long)tsc_to_ns(hold_ticks))]++;
+}
+
+static void print_histogram(const char *name, long long hist[STAT_BUCKETS]) {
+    printf("[threads] %s histogram:", name);
+    for (int b = 0; b < STAT_BUCKETS; ++b) {
+        if (hist[b] == 0) continue;
+        printf(" <%lluns:%lld", 1ULL << (b + 1), hist[b]);
+    }
+    printf("\n");
+}
+
+void thread_stats_report(void) {
+    if (!stats_on || nworkers == 0) return;
+    long long wait_hist[STAT_BUCKETS] = { 0 };
+    long long hold_hist[STAT_BUCKETS] = { 0 };
+    double max_busy = 0.0, sum_busy = 0.0;
+
+    printf("[threads] %6s %14s %12s %12s %12s\n", "worker", "items", "busy_ms", "wait_ms", "hold_ms");
+    for (int i = 0; i < nworkers; ++i) {
+        const WorkerStats *s = &workers[i];
+        double busy = tsc_to_ns(s->busy_ticks) / 1e6;
+        printf("[threads] %6d %14lld %12.3f %12.3f %12.3f\n", i, s->items, busy,
+               tsc_to_ns(s->wait_ticks) / 1e6, tsc_to_ns(s->hold_ticks) / 1e6);
+        if (busy > max_busy) max_busy = busy;
+        sum_busy += busy;
+        for (int b = 0; b < STAT_BUCKETS; ++b) {
+            wait_hist[b] += s->wait_hist[b];
+            hold_hist[b] += s->hold_hist[b];
+        }
+    }
+    double mean_busy = sum_busy / (double)nworkers;
+    printf("[threads] load imbalance (max/mean busy): %.3f\n", mean_busy > 0.0 ? max_busy / mean_busy : 1.0);
+    print_histogram("lock wait", wait_hist);
+    print_histogram("lock hold", hold_hist);
+}
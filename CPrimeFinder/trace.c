@@ -0,0 +1,160 @@
+//
+//  trace.c
+//  CPrimeFinder
+//
+//  Chrome trace-event export (--trace out.json) for Perfetto/chrome://tracing.
+//  Every thread appends complete ("X") events to its own buffer, so recording
+//  never takes a lock. A thread claims the lowest free buffer on its first
+//  event and hands it back with trace_thread_end, so the pools that each run
+//  of a mode starts reuse the same buffers (and tids). The buffers are written
+//  out after the run.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "pprimes.h"
+
+#define MAX_TRACE_THREADS 1024
+#define TRACE_EVENTS_PER_THREAD (1 << 20)
+
+typedef struct {
+    const char *name;
+    unsigned long long start;
+    unsigned long long end;
+    long long arg;
+} TraceEvent;
+
+typedef struct {
+    TraceEvent *events;
+    long long count;
+    long long capacity;
+    long long dropped;    // events past TRACE_EVENTS_PER_THREAD
+} TraceBuffer;
+
+static const char *trace_path = NULL;
+static unsigned long long trace_base = 0;
+static TraceBuffer buffers[MAX_TRACE_THREADS];
+static unsigned char buffer_taken[MAX_TRACE_THREADS];
+static int nbuffers = 0;              // buffers ever claimed
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_llong unrecorded = 0;   // events of threads that found every buffer taken
+static _Thread_local TraceBuffer *my_buffer = NULL;
+static _Thread_local int my_buffer_claimed = 0;
+
+static TraceBuffer *thread_buffer(void);
+
+//Starts recording; the calling thread becomes tid 0
+void trace_init(const char *path) {
+    trace_path = path;
+    tsc_calibrate();
+    trace_base = tsc_now();
+    thread_buffer();
+}
+
+int trace_enabled(void) {
+    return trace_path != NULL;
+}
+
+//This thread's buffer, claimed on first use; NULL while all slots are taken
+static TraceBuffer *thread_buffer(void) {
+    if (!my_buffer_claimed) {
+        my_buffer_claimed = 1;
+        pthread_mutex_lock(&buffer_lock);
+        for (int slot = 0; slot < MAX_TRACE_THREADS; ++slot) {
+            if (buffer_taken[slot]) continue;
+            buffer_taken[slot] = 1;
+            if (slot >= nbuffers) nbuffers = slot + 1;
+            my_buffer = &buffers[slot];
+            break;
+        }
+        pthread_mutex_unlock(&buffer_lock);
+    }
+    return my_buffer;
+}
+
+//Hands this thread's buffer, events and all, to the next thread that starts
+//recording; called by pool threads just before they exit
+void trace_thread_end(void) {
+    if (!my_buffer) return;
+    pthread_mutex_lock(&buffer_lock);
+    buffer_taken[my_buffer - buffers] = 0;
+    pthread_mutex_unlock(&buffer_lock);
+    my_buffer = NULL;
+    my_buffer_claimed = 0;
+}
+
+//Records one complete event [start, end] in ticks; arg is shown in the event's details
+void trace_event(const char *name, unsigned long long start, unsigned long long end, long long arg) {
+    if (!trace_path) return;
+    TraceBuffer *b = thread_buffer();
+    if (!b) {
+        atomic_fetch_add(&unrecorded, 1);
+        return;
+    }
+    if (b->count == b->capacity) {
+        if (b->capacity == TRACE_EVENTS_PER_THREAD) {
+            b->dropped++;
+            return;
+        }
+        long long grown = b->capacity ? b->capacity * 2 : 4096;
+        TraceEvent *events = (TraceEvent *)realloc(b->events, sizeof(TraceEvent) * (size_t)grown);
+        if (!events) {
+            b->dropped++;
+            return;
+        }
+        b->events = events;
+        b->capacity = grown;
+    }
+    TraceEvent *e = &b->events[b->count++];
+    e->name = name;
+    e->start = start;
+    e->end = end;
+    e->arg = arg;
+}
+
+static double trace_us(unsigned long long ticks) {
+    return ticks > trace_base ? tsc_to_ns(ticks - trace_base) / 1000.0 : 0.0;
+}
+
+//Writes every buffer as Chrome trace-event JSON and frees them
+void trace_write(void) {
+    if (!trace_path) return;
+    FILE *out = fopen(trace_path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write trace to '%s'\n", trace_path);
+        return;
+    }
+    long long dropped = 0;
+    int first = 1;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int t = 0; t < nbuffers; ++t) {
+        TraceBuffer *b = &buffers[t];
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                     "\"args\": {\"name\": \"%s %d\"}}", first ? "" : ",\n", t, t ? "worker" : "main", t);
+        first = 0;
+        for (long long i = 0; i < b->count; ++i) {
+            const TraceEvent *e = &b->events[i];
+            double ts = trace_us(e->start);
+            fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                         "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"value\": %lld}}",
+                    e->name, t, ts, trace_us(e->end) - ts, e->arg);
+        }
+        dropped += b->dropped;
+        free(b->events);
+        b->events = NULL;
+        b->count = b->capacity = 0;
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    if (dropped > 0) {
+        fprintf(stderr, "Warning: trace buffers were full; %lld events dropped\n", dropped);
+    }
+    long long lost = atomic_load(&unrecorded);
+    if (lost > 0) {
+        fprintf(stderr, "Warning: more than %d threads traced at once; %lld events dropped\n",
+                MAX_TRACE_THREADS, lost);
+    }
+}
@@ -0,0 +1,313 @@
+//
+//  tune.c
+//  CPrimeFinder
+//
+//  Auto-tuner (--tune) and the per-host tuning profile. The tuner searches
+//  thread count, segment size and pre-sieve depth (segmented engine) or chunk
+//  size (threaded engine) one parameter at a time with short in-process
+//  benchmarks, and stores the winner under $XDG_CONFIG_HOME/pprimes/tuning.conf
+//  keyed by CPU model, engine and the decade of max_value. Normal runs load the
+//  matching entry for any parameter not given on the command line; without
+//  --engine or a thread count they also take the engine, using whichever tuned
+//  entry was fastest.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include "pprimes.h"
+
+#define PROFILE_LINE_MAX 1024
+#define PROFILE_KEY_MAX 512
+#define MAX_PROFILE_LINES 4096
+
+//Profile file location; 0 if neither XDG_CONFIG_HOME nor HOME is set
+static int profile_path(char *buf, size_t cap, int create_dir) {
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    char dir[PROFILE_LINE_MAX - 32];
+    if (xdg && *xdg) {
+        snprintf(dir, sizeof(dir), "%s/pprimes", xdg);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.config/pprimes", home);
+    } else {
+        return 0;
+    }
+    if (create_dir) {
+        //make the parent (~/.config) too when XDG_CONFIG_HOME is unset
+        char *slash = strrchr(dir, '/');
+        *slash = '\0';
+        mkdir(dir, 0755);
+        *slash = '/';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) return 0;
+    }
+    snprintf(buf, cap, "%s/tuning.conf", dir);
+    return 1;
+}
+
+//CPU model string with tabs and newlines removed
+static void cpu_model(char *buf, size_t cap) {
+    snprintf(buf, cap, "unknown");
+#ifdef __APPLE__
+    size_t len = cap;
+    if (sysctlbyname("machdep.cpu.brand_string", buf, &len, NULL, 0) != 0) snprintf(buf, cap, "unknown");
+#else
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f) return;
+    char line[PROFILE_LINE_MAX];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) != 0) continue;
+        char *colon = strchr(line, ':');
+        if (!colon) continue;
+        colon++;
+        while (*colon == ' ') colon++;
+        snprintf(buf, cap, "%s", colon);
+        break;
+    }
+    fclose(f);
+#endif
+    for (char *c = buf; *c; ++c) {
+        if (*c == '\t' || *c == '\n') *c = ' ';
+    }
+    size_t n = strlen(buf);
+    while (n > 0 && buf[n - 1] == ' ') buf[--n] = '\0';
+}
+
+static int decade_of(long long n) {
+    int d = 0;
+    while (n >= 10) {
+        n /= 10;
+        d++;
+    }
+    return d;
+}
+
+//"cpu=...\tengine=...\tdecade=N", the part of a profile line that identifies it
+static void profile_key(const Options *opts, const char *model, char *buf, size_t cap) {
+    snprintf(buf, cap, "cpu=%s\tengine=%s\tdecade=%d", model, engine_label(opts), decade_of(opts->max_value));
+}
+
+static int line_has_key(const char *line, const char *key) {
+    size_t keylen = strlen(key);
+    return strncmp(line, key, keylen) == 0 && line[keylen] == '\t';
+}
+
+//Reads "\tname=N" into *out, leaving it alone when the field is absent; 0 if
+//the value is not an integer in [lo, hi], the range the command line accepts
+static int field_value(const char *line, const char *name, long long lo, long long hi, long long *out) {
+    char pattern[64], text[32];
+    snprintf(pattern, sizeof(pattern), "\t%s=", name);
+    const char *at = strstr(line, pattern);
+    if (!at) return 1;
+    at += strlen(pattern);
+    size_t len = strcspn(at, "\t\n");
+    if (len >= sizeof(text)) return 0;
+    memcpy(text, at, len);
+    text[len] = '\0';
+    long long value;
+    if (!parse_integer_arguments(text, &value) || value < lo || value > hi) return 0;
+    *out = value;
+    return 1;
+}
+
+//Fills in parameters the user did not set from the matching profile entry.
+//Without --engine or a thread count, entries for every tunable engine match and
+//the fastest wins, so a plain run picks up what --tune found whichever engine it
+//tuned. A thread count alone already picks the engine, so that one is kept
+void tune_apply_profile(Options *opts) {
+    static const Engine tunable[] = { ENGINE_THREADED, ENGINE_SEGMENTED };
+    int engine_fixed = (opts->explicit_params & (EXPLICIT_ENGINE | EXPLICIT_THREADS)) != 0;
+    char path[PROFILE_LINE_MAX], model[256], key[PROFILE_KEY_MAX], line[PROFILE_LINE_MAX];
+    if (!profile_path(path, sizeof(path), 0)) return;
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    cpu_model(model, sizeof(model));
+    Options best = *opts;
+    double best_ms = -1.0;
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        Options cand = *opts;
+        int match = 0;
+        for (size_t e = 0; e < sizeof(tunable) / sizeof(tunable[0]) && !match; ++e) {
+            if (engine_fixed && tunable[e] != opts->engine) continue;
+            cand.engine = tunable[e];
+            profile_key(&cand, model, key, sizeof(key));
+            match = line_has_key(line, key);
+        }
+        if (!match) continue;
+        long long threads = cand.thread_count, segment = cand.segment_size;
+        long long presieve = cand.presieve_depth, chunk = cand.chunk_size;
+        if (!field_value(line, "threads", 1, LLONG_MAX, &threads)
+            || !field_value(line, "segment", 64, LLONG_MAX, &segment)
+            || !field_value(line, "presieve", 1, 7, &presieve)
+            || !field_value(line, "chunk", 1, LLONG_MAX, &chunk)) {
+            fprintf(stderr, "Warning: ignoring malformed entry on line %d of %s\n", lineno, path);
+            continue;
+        }
+        const char *at = strstr(line, "\tms=");
+        double ms = at ? strtod(at + 4, NULL) : 0.0;
+        if (best_ms >= 0.0 && ms >= best_ms) continue;
+        if (!(opts->explicit_params & EXPLICIT_THREADS)) cand.thread_count = threads;
+        if (!(opts->explicit_params & EXPLICIT_SEGMENT)) cand.segment_size = segment;
+        if (!(opts->explicit_params & EXPLICIT_PRESIEVE)) cand.presieve_depth = (int)presieve;
+        if (!(opts->explicit_params & EXPLICIT_CHUNK)) cand.chunk_size = chunk;
+        best = cand;
+        best_ms = ms;
+    }
+    fclose(f);
+    if (best_ms < 0.0) return;
+    *opts = best;
+    if (!opts->report) {
+        fprintf(stderr, "Note: using tuned parameters from %s (engine=%s threads=%lld segment=%lld presieve=%d chunk=%lld)\n",
+                path, engine_label(opts), opts->thread_count, opts->segment_size, opts->presieve_depth,
+                opts->chunk_size);
+    }
+}
+
+//Replaces (or appends) this host's entry in the profile
+static int save_profile(const Options *opts, double ms) {
+    char path[PROFILE_LINE_MAX], model[256], key[PROFILE_KEY_MAX], entry[PROFILE_LINE_MAX];
+    if (!profile_path(path, sizeof(path), 1)) {
+        fprintf(stderr, "Error: cannot locate a config directory for the tuning profile\n");
+        return 0;
+    }
+    cpu_model(model, sizeof(model));
+    profile_key(opts, model, key, sizeof(key));
+    snprintf(entry, sizeof(entry), "%s\tthreads=%lld\tsegment=%lld\tpresieve=%d\tchunk=%lld\tms=%.3f\n",
+             key, opts->thread_count, opts->segment_size, opts->presieve_depth, opts->chunk_size, ms);
+
+    static char lines[MAX_PROFILE_LINES][PROFILE_LINE_MAX];
+    int nlines = 0;
+    FILE *f = fopen(path, "r");
+    if (f) {
+        while (nlines < MAX_PROFILE_LINES && fgets(lines[nlines], PROFILE_LINE_MAX, f)) {
+            if (line_has_key(lines[nlines], key)) continue;
+            if (strncmp(lines[nlines], "#", 1) == 0) continue;
+            nlines++;
+        }
+        fclose(f);
+    }
+
+    char tmp[PROFILE_LINE_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "Error: cannot write tuning profile '%s'\n", tmp);
+        return 0;
+    }
+    fprintf(f, "# pprimes tuning profile, written by pprimes --tune\n");
+    for (int i = 0; i < nlines; ++i) fputs(lines[i], f);
+    fputs(entry, f);
+    fclose(f);
+    if (rename(tmp, path) != 0) {
+        fprintf(stderr, "Error: cannot replace tuning profile '%s'\n", path);
+        return 0;
+    }
+    printf("[tune] wrote %s\n", path);
+    return 1;
+}
+
+//Median time of a short benchmark; more repetitions for quick configurations
+static double measure(const Options *opts, unsigned char *is_prime_arr) {
+    double samples[7];
+    long long primes = 0;
+    if (!bench_runs(opts, is_prime_arr, 1, 1, samples, &primes)) exit(EXIT_FAILURE);
+    long long reps = samples[0] < 20.0 ? 7 : (samples[0] < 200.0 ? 3 : 1);
+    if (reps > 1 && !bench_runs(opts, is_prime_arr, 0, reps, samples, &primes)) exit(EXIT_FAILURE);
+    double ms = sample_median(samples, reps);
+    printf("[tune] threads=%lld segment=%lld presieve=%d chunk=%lld: %.3f ms\n",
+           opts->thread_count, opts->segment_size, opts->presieve_depth, opts->chunk_size, ms);
+    return ms;
+}
+
+//Tries each candidate for *param and keeps the fastest
+static double try_values(Options *opts, unsigned char *arr, long long *param, const long long *values,
+                         int nvalues, double best_ms) {
+    long long best = *param;
+    for (int i = 0; i < nvalues; ++i) {
+        if (values[i] == best) continue;
+        *param = values[i];
+        double ms = measure(opts, arr);
+        if (ms < best_ms) {
+            best_ms = ms;
+            best = values[i];
+        }
+    }
+    *param = best;
+    return best_ms;
+}
+
+//Walks *param up by factor while it keeps getting faster, then down
+static double walk_values(Options *opts, unsigned char *arr, long long *param, long long lo, long long hi,
+                          double best_ms) {
+    for (int dir = 0; dir < 2; ++dir) {
+        for (;;) {
+            long long start = *param;
+            long long next = dir == 0 ? start * 2 : start / 2;
+            if (next < lo || next > hi) break;
+            *param = next;
+            double ms = measure(opts, arr);
+            if (ms >= best_ms) {
+                *param = start;
+                break;
+            }
+            best_ms = ms;
+        }
+    }
+    return best_ms;
+}
+
+//Searches the parameter space for opts->max_value and saves the best setting
+int run_tune(Options *opts) {
+    if (!(opts->explicit_params & EXPLICIT_ENGINE)) opts->engine = ENGINE_SEGMENTED;
+    if (opts->engine == ENGINE_SEQUENTIAL) {
+        fprintf(stderr, "Error: the sequential engine has nothing to tune.\n");
+        return EXIT_FAILURE;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    long long thread_values[16];
+    int nthreads = 0;
+    for (long long t = 1; t <= 2 * cpus && nthreads < 15; t *= 2) thread_values[nthreads++] = t;
+    if ((cpus & (cpus - 1)) != 0) thread_values[nthreads++] = cpus;
+
+    printf("[tune] engine: %s max_value: %lld cpus: %ld\n", engine_label(opts), opts->max_value, cpus);
+    unsigned char *arr = alloc_results(opts->max_value);
+
+    opts->thread_count = cpus;
+    double best_ms = measure(opts, arr);
+    best_ms = try_values(opts, arr, &opts->thread_count, thread_values, nthreads, best_ms);
+    if (opts->engine == ENGINE_SEGMENTED) {
+        best_ms = walk_values(opts, arr, &opts->segment_size, 1LL << 12, 1LL << 24, best_ms);
+        int best_depth = opts->presieve_depth;
+        for (int depth = 1; depth <= 7; ++depth) {
+            if (depth == best_depth) continue;
+            opts->presieve_depth = depth;
+            double ms = measure(opts, arr);
+            if (ms < best_ms) {
+                best_ms = ms;
+                best_depth = depth;
+            }
+        }
+        opts->presieve_depth = best_depth;
+    } else {
+        best_ms = walk_values(opts, arr, &opts->chunk_size, 1, 1LL << 20, best_ms);
+    }
+    //thread count again, since the best count can move with the other parameters
+    best_ms = try_values(opts, arr, &opts->thread_count, thread_values, nthreads, best_ms);
+    free_results(arr, opts->max_value);
+
+    printf("[tune] best: threads=%lld segment=%lld presieve=%d chunk=%lld: %.3f ms\n",
+           opts->thread_count, opts->segment_size, opts->presieve_depth, opts->chunk_size, best_ms);
+    return save_profile(opts, best_ms) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+//
+//  u128.c
+//  CPrimeFinder
+//
+//  Decimal formatting and parsing for unsigned 128-bit values, which printf
+//  and strtoull cannot handle.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include "pprimes.h"
+
+//Writes v in decimal to buf (at least U128_DIGITS + 1 bytes) and returns buf
+char *u128_format(unsigned __int128 v, char *buf) {
+    char digits[U128_DIGITS];
+    int k = 0;
+    //19 digits per 128-bit division while v needs them, 64-bit divisions after
+    while (v >> 64) {
+        unsigned long long low = (unsigned long long)(v % 10000000000000000000ULL);
+        v /= 10000000000000000000ULL;
+        for (int i = 0; i < 19; ++i) {
+            digits[k++] = (char)('0' + (int)(low % 10));
+            low /= 10;
+        }
+    }
+    unsigned long long w = (unsigned long long)v;
+    do {
+        digits[k++] = (char)('0' + (int)(w % 10));
+        w /= 10;
+    } while (w);
+    int len = 0;
+    while (k) buf[len++] = digits[--k];
+    buf[len] = '\0';
+    return buf;
+}
+
+//Parses a decimal value in [0, 2^128) with optional surrounding blanks; returns 0 if invalid
+int parse_u128(const char *input, unsigned __int128 *out) {
+    const unsigned __int128 max = ~(unsigned __int128)0;
+    const char *c = input;
+    while (isspace((unsigned char)*c)) c++;
+    if (!isdigit((unsigned char)*c)) return 0;
+    unsigned __int128 v = 0;
+    for (; isdigit((unsigned char)*c); ++c) {
+        unsigned digit = (unsigned)(*c - '0');
+        if (v > (max - digit) / 10) return 0;
+        v = v * 10 + digit;
+    }
+    while (isspace((unsigned char)*c)) c++;
+    if (*c != '\0') return 0;
+    *out = v;
+    return 1;
+}
@@ -0,0 +1,278 @@
+//
+//  microbench.c
+//  CPrimeFinderBench
+//
+//  Microbenchmarks for the individual pprimes kernels. Every kernel runs over
+//  each requested size, split evenly across each requested thread count, and
+//  one CSV row per (kernel, size, threads) is written to stdout.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../CPrimeFinder/pprimes.h"
+
+#define MAX_LIST 32
+
+//Inputs shared by every kernel invocation
+typedef struct {
+    unsigned char *buf;       // scratch results array sized for the largest run
+    const unsigned char *sieved; // correct results array for count/format
+    PreSieve presieve;
+    long long *primes;        // odd base primes past the pre-sieve pattern
+    long long nprimes;
+    long long segment_size;
+} KernelInputs;
+
+//One kernel: prepare runs untimed before each repetition, run handles [lo, hi)
+typedef struct {
+    const char *name;
+    void (*prepare)(KernelInputs *in, long long size);
+    long long (*run)(KernelInputs *in, long long lo, long long hi);
+} Kernel;
+
+static long long kernel_is_prime(KernelInputs *in, long long lo, long long hi) {
+    (void)in;
+    long long found = 0;
+    for (long long n = lo; n < hi; ++n) found += is_prime(n);
+    return found;
+}
+
+static long long kernel_presieve(KernelInputs *in, long long lo, long long hi) {
+    for (long long s = lo; s < hi; s += in->segment_size) {
+        long long e = (s + in->segment_size < hi) ? s + in->segment_size : hi;
+        presieve_fill(&in->presieve, in->buf + s, s, e - s);
+    }
+    return in->buf[lo];
+}
+
+static void prepare_crossoff(KernelInputs *in, long long size) {
+    presieve_fill(&in->presieve, in->buf, 0, size);
+}
+
+static long long kernel_crossoff(KernelInputs *in, long long lo, long long hi) {
+    for (long long s = lo; s < hi; s += in->segment_size) {
+        long long e = (s + in->segment_size < hi) ? s + in->segment_size : hi;
+        cross_off_segment(in->buf + s, s, e - s, in->primes, in->nprimes);
+    }
+    return in->buf[lo];
+}
+
+static long long kernel_count(KernelInputs *in, long long lo, long long hi) {
+    return count_primes_range(in->sieved, lo, hi);
+}
+
+static long long kernel_format(KernelInputs *in, long long lo, long long hi) {
+    char *buf = (char *)malloc(OUTPUT_BUFFER_SIZE);
+    if (!buf) return 0;
+    long long n = lo;
+    size_t total = 0;
+    while (n < hi) total += format_primes(buf, OUTPUT_BUFFER_SIZE, in->sieved, &n, hi);
+    free(buf);
+    return (long long)total;
+}
+
+static const Kernel kernels[] = {
+    { "is_prime", NULL, kernel_is_prime },
+    { "presieve", NULL, kernel_presieve },
+    { "crossoff", prepare_crossoff, kernel_crossoff },
+    { "count", NULL, kernel_count },
+    { "format", NULL, kernel_format },
+};
+
+//Start gate so thread creation stays outside the measured region
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int open;
+} Gate;
+
+typedef struct {
+    const Kernel *kernel;
+    KernelInputs *in;
+    Gate *gate;
+    long long lo;
+    long long hi;
+    struct timespec end;
+    long long sink;
+} KernelThread;
+
+static void *kernel_thread_function(void *arg) {
+    KernelThread *t = (KernelThread *)arg;
+    pthread_mutex_lock(&t->gate->lock);
+    while (!t->gate->open) pthread_cond_wait(&t->gate->cond, &t->gate->lock);
+    pthread_mutex_unlock(&t->gate->lock);
+    t->sink = t->kernel->run(t->in, t->lo, t->hi);
+    clock_gettime(CLOCK_MONOTONIC, &t->end);
+    return NULL;
+}
+
+static double timespec_diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (double)(b->tv_sec - a->tv_sec) * 1e9 + (double)(b->tv_nsec - a->tv_nsec);
+}
+
+//Runs the kernel once over [0, size) split across nthreads; returns wall time in ns
+static double time_kernel(const Kernel *kernel, KernelInputs *in, long long size, int nthreads) {
+    if (kernel->prepare) kernel->prepare(in, size);
+
+    Gate gate;
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    gate.open = 0;
+
+    pthread_t threads[256];
+    KernelThread work[256];
+    long long per = (size + nthreads - 1) / nthreads;
+    for (int i = 0; i < nthreads; ++i) {
+        work[i].kernel = kernel;
+        work[i].in = in;
+        work[i].gate = &gate;
+        work[i].lo = (long long)i * per;
+        work[i].hi = (work[i].lo + per < size) ? work[i].lo + per : size;
+        if (work[i].lo > size) work[i].lo = size;
+        if (pthread_create(&threads[i], NULL, kernel_thread_function, &work[i]) != 0) {
+            fprintf(stderr, "Error: pthread_create failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct timespec start;
+    pthread_mutex_lock(&gate.lock);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gate.open = 1;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+
+    double ns = 0.0;
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+        double t = timespec_diff_ns(&start, &work[i].end);
+        if (t > ns) ns = t;
+    }
+    pthread_cond_destroy(&gate.cond);
+    pthread_mutex_destroy(&gate.lock);
+    return ns;
+}
+
+//parses "a,b,c" into values (each >= 1); returns how many were read or 0 on error
+static int parse_list(const char *text, long long *values, int max) {
+    int n = 0;
+    char *copy = strdup(text);
+    if (!copy) return 0;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == max || !parse_integer_arguments(tok, &values[n]) || values[n] < 1) {
+            free(copy);
+            return 0;
+        }
+        n++;
+    }
+    free(copy);
+    return n;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--sizes=N,...] [--threads=T,...] [--reps=R] [--kernels=name,...]\n", prog);
+    fprintf(stderr, "       [--isa=scalar|sse4.2|avx2|avx512]\n");
+    fprintf(stderr, "  kernels: is_prime presieve crossoff count format\n");
+}
+
+int main(int argc, const char *argv[]) {
+    long long sizes[MAX_LIST] = { 10000, 1000000, 10000000 };
+    long long threads[MAX_LIST] = { 1, 2, 4 };
+    int nsizes = 3, nthreads = 3;
+    long long reps = 5;
+    const char *only = NULL;
+    Isa isa = ISA_AUTO;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--sizes=", 8) == 0) {
+            nsizes = parse_list(arg + 8, sizes, MAX_LIST);
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            nthreads = parse_list(arg + 10, threads, MAX_LIST);
+        } else if (strncmp(arg, "--reps=", 7) == 0) {
+            if (!parse_integer_arguments(arg + 7, &reps) || reps < 1) reps = 0;
+        } else if (strncmp(arg, "--kernels=", 10) == 0) {
+            only = arg + 10;
+        } else if (strncmp(arg, "--isa=", 6) == 0) {
+            if (!parse_isa(arg + 6, &isa)) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (nsizes == 0 || nthreads == 0 || reps == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        if (threads[i] > 256) {
+            fprintf(stderr, "Error: at most 256 threads are supported.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!simd_init(isa)) return EXIT_FAILURE;
+    fprintf(stderr, "isa: %s\n", isa_name(simd_isa()));
+
+    long long max_size = 0;
+    for (int i = 0; i < nsizes; ++i) if (sizes[i] > max_size) max_size = sizes[i];
+
+    //shared inputs: a scratch array and one correctly sieved array
+    KernelInputs in;
+    Options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.max_value = max_size;
+    opts.thread_count = 1;
+    opts.engine = ENGINE_SEGMENTED;
+    opts.segment_size = DEFAULT_SEGMENT_SIZE;
+    opts.presieve_depth = DEFAULT_PRESIEVE_DEPTH;
+    unsigned char *sieved = alloc_results(max_size);
+    run_segmented(&opts, sieved);
+    in.sieved = sieved;
+    in.buf = alloc_results(max_size);
+    in.segment_size = opts.segment_size;
+    presieve_init(&in.presieve, opts.presieve_depth);
+    in.primes = sieve_base_primes(isqrt_ll(max_size), &in.nprimes);
+    long long skip = 0;
+    while (skip < in.nprimes && in.primes[skip] <= in.presieve.largest) skip++;
+    long long *all_primes = in.primes;
+    in.primes += skip;
+    in.nprimes -= skip;
+
+    double *samples = (double *)malloc(sizeof(double) * (size_t)reps);
+    if (!samples) {
+        fprintf(stderr, "Error: failed to allocate samples\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("kernel,size,threads,reps,min_ns,median_ns,ns_per_item,items_per_sec\n");
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        const Kernel *kernel = &kernels[k];
+        if (only && !strstr(only, kernel->name)) continue;
+        for (int s = 0; s < nsizes; ++s) {
+            for (int t = 0; t < nthreads; ++t) {
+                for (long long r = 0; r < reps; ++r) {
+                    samples[r] = time_kernel(kernel, &in, sizes[s], (int)threads[t]);
+                }
+                //same statistics as --bench; sorts samples, so samples[0] is the minimum
+                double med = sample_median(samples, reps);
+                printf("%s,%lld,%lld,%lld,%.0f,%.0f,%.4f,%.4e\n", kernel->name, sizes[s], threads[t], reps,
+                       samples[0], med, med / (double)sizes[s], (double)sizes[s] / (med / 1e9));
+                fflush(stdout);
+            }
+        }
+    }
+
+    free(samples);
+    free(all_primes);
+    presieve_free(&in.presieve);
+    free_results(in.buf, max_size);
+    free_results(sieved, max_size);
+    return EXIT_SUCCESS;
+}